@@ -0,0 +1,211 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "alloc.h"
+#include "placement.h"
+#include "threads.h"
+
+// Huge-page blocks start at one of COLOURS offsets into their first page, in
+// turn, COLOUR_STEP (a page plus a cache line) apart.  Otherwise every matrix
+// would start at the same offset from a 2 MB boundary, so A[i][j], B[i][j] and
+// C[i][j] would all compete for the same cache sets.
+#define COLOURS 8
+#define COLOUR_STEP 4160
+
+/*
+ * The policy for blocks of HUGE_PAGE bytes or more.  Defaults to transparent huge
+ * pages; the CACHEBLOCK_HUGEPAGES environment variable (off, thp or explicit)
+ * overrides it at startup.
+ */
+HugePages Matrix_Huge_Pages = HUGE_THP;
+
+/*
+ * Stored in the MATRIX_ALIGN bytes just before every block that matrix_alloc hands
+ * out, so that matrix_free knows how to give it back.
+ */
+typedef struct alloc_header_t {
+    void *base;    // start of the underlying allocation
+    size_t length; // its length, if it was mmap'd;  0 if it came from aligned_alloc
+} AllocHeader;
+
+_Static_assert(sizeof(AllocHeader) <= MATRIX_ALIGN, "AllocHeader must fit in the alignment padding");
+
+static size_t round_up(size_t x, size_t m) {
+    return (x + m - 1) / m * m;
+}
+
+/*
+ * Maps `length` bytes (a multiple of HUGE_PAGE) starting on a HUGE_PAGE boundary,
+ * under the current huge-page policy.  Returns NULL on failure.
+ */
+static void *map_huge(size_t length) {
+#ifdef MAP_HUGETLB
+    if (Matrix_Huge_Pages == HUGE_EXPLICIT) {
+        void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return p;
+        // No reserved huge pages (see /proc/sys/vm/nr_hugepages):  fall back to THP
+    }
+#endif
+    // Over-map by one huge page, then trim both ends back to an aligned region
+    char *raw = mmap(NULL, length + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+
+    char *p = (char *)round_up((uintptr_t)raw, HUGE_PAGE);
+    if (p > raw) munmap(raw, p - raw);
+    if (p + length < raw + length + HUGE_PAGE) munmap(p + length, raw + length + HUGE_PAGE - (p + length));
+#ifdef MADV_HUGEPAGE
+    if (Matrix_Huge_Pages != HUGE_OFF) madvise(p, length, MADV_HUGEPAGE);
+#endif
+    return p;
+} // map_huge
+
+/*
+ * Allocates `bytes` bytes aligned to MATRIX_ALIGN (64, a cache line, and the width
+ * of an AVX-512 vector), or returns NULL.  Blocks of 2 MB or more are mapped
+ * directly from the kernel, on 2 MB boundaries, and backed by huge pages as
+ * Matrix_Huge_Pages directs; a 4096 x 4096 matrix then needs 64 TLB entries rather
+ * than 32768.  (Each such block also gets the next of several starting offsets;
+ * see COLOURS.)  Smaller blocks come from aligned_alloc.
+ *
+ * The memory is not initialized, and (for mapped blocks) not yet even backed by
+ * physical pages:  on a NUMA machine, each page lands on the node of the thread
+ * that first writes it.  See matrix_first_touch.  Free the block with matrix_free.
+ */
+void *matrix_alloc(size_t bytes) {
+    size_t total = MATRIX_ALIGN + bytes;
+    AllocHeader h;
+    char *base;
+
+    char *p;
+
+    if (total >= HUGE_PAGE && Matrix_Huge_Pages != HUGE_OFF) {
+        static _Atomic unsigned colour;
+        size_t offset = (colour++ % COLOURS) * COLOUR_STEP;
+
+        h.length = round_up(total + offset, HUGE_PAGE);
+        base = map_huge(h.length);
+        p = base + offset;
+    } else {
+        h.length = 0;
+        base = aligned_alloc(MATRIX_ALIGN, round_up(total, MATRIX_ALIGN));
+        p = base;
+    }
+    if (!base) return NULL;
+
+    h.base = base;
+    memcpy(p, &h, sizeof(h));
+    return p + MATRIX_ALIGN;
+} // matrix_alloc
+
+/*
+ * Frees a block from matrix_alloc.  Does nothing if p is NULL.
+ */
+void matrix_free(void *p) {
+    if (!p) return;
+
+    AllocHeader h;
+    memcpy(&h, (char *)p - MATRIX_ALIGN, sizeof(h));
+    if (h.length) {
+        munmap(h.base, h.length);
+    } else {
+        free(h.base);
+    }
+} // matrix_free
+
+typedef struct touch_job_t {
+    char *base;            // the HUGE_PAGE boundary at or before the block
+    char *lo, *hi;         // the block
+    char *map_lo, *map_hi; // what may be bound:  its whole mapping, if it has one
+} TouchJob;
+
+static void first_touch_tile(void *ctx, int tile) {
+    TouchJob *job = ctx;
+    char *start = job->base + (size_t)tile * HUGE_PAGE, *end = start + HUGE_PAGE;
+    char *bind_lo = (start > job->map_lo ? start : job->map_lo);
+    char *bind_hi = (end < job->map_hi ? end : job->map_hi);
+    char *lo = (start > job->lo ? start : job->lo), *hi = (end < job->hi ? end : job->hi);
+
+    numa_bind(bind_lo, bind_hi - bind_lo, numa_current_node());
+    memset(lo, 0, hi - lo);
+}
+
+/*
+ * Zeroes the `bytes` bytes at p, a block from matrix_alloc, on `nthreads` threads
+ * (<= 0 means one per online CPU), one HUGE_PAGE-aligned range each, in the same
+ * order as run_tiles_static.  Done right after matrix_alloc, this places each page
+ * of a matrix on the NUMA node of the thread that a statically scheduled kernel
+ * (such as matmult_bl_mt) will later have work on it.  With Numa_Placement on, the
+ * workers are pinned, and each range is also bound to its worker's node (see
+ * numa_bind):  for a mapped block, the whole huge page, so that no page is split
+ * between two nodes and each binding leaves the mapping cut on 2 MB boundaries.
+ */
+void matrix_first_touch(void *p, size_t bytes, int nthreads) {
+    AllocHeader h;
+    memcpy(&h, (char *)p - MATRIX_ALIGN, sizeof(h));
+
+    TouchJob job = {.base = (char *)((uintptr_t)p / HUGE_PAGE * HUGE_PAGE), .lo = p, .hi = (char *)p + bytes,
+                    .map_lo = p, .map_hi = (char *)p + bytes};
+    int ntiles = (int)((job.hi - job.base + HUGE_PAGE - 1) / HUGE_PAGE);
+
+    if (h.length) {
+        job.map_lo = h.base;
+        job.map_hi = (char *)h.base + h.length;
+    }
+    run_tiles_static(nthreads, ntiles, first_touch_tile, &job);
+} // matrix_first_touch
+
+const char *huge_pages_name(HugePages mode) {
+    static const char *names[HUGE_MODES] = {"off", "thp", "explicit"};
+    return (mode >= 0 && mode < HUGE_MODES) ? names[mode] : "?";
+} // huge_pages_name
+
+__attribute__((constructor)) static void alloc_init(void) {
+    char *env = getenv("CACHEBLOCK_HUGEPAGES");
+
+    for (int m = 0; env && m < HUGE_MODES; m++) {
+        if (!strcmp(env, huge_pages_name(m))) Matrix_Huge_Pages = m;
+    }
+} // alloc_init
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Makes sure the arena can hold `bytes` bytes, allocating (or, if it is empty but
+ * too small, reallocating) its block.  An arena starts out zero-initialized, as
+ * {0}.  Returns false if the allocation fails.
+ */
+bool arena_reserve(Arena *a, size_t bytes) {
+    if (bytes <= a->size) return true;
+    if (a->used) return false; // would move blocks already handed out
+
+    matrix_free(a->base);
+    a->base = matrix_alloc(bytes);
+    a->size = a->base ? bytes : 0;
+    return a->base != NULL;
+} // arena_reserve
+
+/*
+ * Hands out the next `bytes` bytes of the arena, aligned to MATRIX_ALIGN, or NULL
+ * if they don't fit.  To give back everything taken since some point, save
+ * a->used at that point and restore it.
+ */
+void *arena_take(Arena *a, size_t bytes) {
+    size_t need = round_up(bytes, MATRIX_ALIGN);
+
+    if (need > a->size - a->used) return NULL;
+
+    void *p = a->base + a->used;
+    a->used += need;
+    return p;
+} // arena_take
+
+void arena_reset(Arena *a) {
+    a->used = 0;
+} // arena_reset
+
+void arena_free(Arena *a) {
+    matrix_free(a->base);
+    *a = (Arena){0};
+} // arena_free
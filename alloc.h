@@ -0,0 +1,44 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Every block from matrix_alloc (and every arena_take) starts on this boundary
+#define MATRIX_ALIGN 64
+
+// Blocks at least this big are mapped directly, and are candidates for huge pages
+#define HUGE_PAGE (2UL << 20)
+
+// Huge-page policy for large blocks (see matrix_alloc)
+typedef enum huge_pages_t {
+    HUGE_OFF,      // ordinary pages
+    HUGE_THP,      // 2 MB-aligned mappings, advised MADV_HUGEPAGE (transparent huge pages)
+    HUGE_EXPLICIT, // MAP_HUGETLB from the reserved pool, else as HUGE_THP
+    HUGE_MODES
+} HugePages;
+
+extern HugePages Matrix_Huge_Pages;
+
+void *matrix_alloc(size_t bytes);
+void matrix_free(void *p);
+void matrix_first_touch(void *p, size_t bytes, int nthreads);
+const char *huge_pages_name(HugePages);
+
+/*
+ * A bump allocator over one matrix_alloc'd block, for scratch buffers that come
+ * and go in LIFO order:  take what's needed, and give it all back at once by
+ * restoring a mark (or resetting).  Not thread-safe.
+ */
+typedef struct arena_t {
+    char *base;
+    size_t size; // capacity, in bytes
+    size_t used; // bytes handed out so far
+} Arena;
+
+bool arena_reserve(Arena *a, size_t bytes);
+void *arena_take(Arena *a, size_t bytes);
+void arena_reset(Arena *a);
+void arena_free(Arena *a);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ *  autotune.c
+ *  CS3410 (F'24)
+ *
+ *  USAGE:  autotune  [-r <reps>] [-w <warmup>] <min_dimension> [<max_dimension>]
+ *
+ *  OVERVIEW:  Finds this machine's best block sizes for matmult_bl and
+ *     transpose_bl, at each matrix size from <min_dimension> up to <max_dimension>
+ *     (doubling), and its best cache tiles for matmult_packed (which
+ *     matmult_tiled shares, untimed) at the largest size.  The winners are merged
+ *     into this host's tuning profile (see tune.h), which every program here
+ *     loads at startup, so that -b left out means "this machine's best".  Each
+ *     candidate is timed in process, as the median of -r runs (default
+ *     TUNE_REPS) from a flushed cache.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "bench.h"
+#include "helpers.h"
+#include "tasks.h"
+#include "tune.h"
+
+// Timed runs per candidate, unless -r asks for more
+#define TUNE_REPS 3
+
+// The block sizes tried, and the values tried for each cache tile
+static const int Block_Sizes[] = {8, 16, 24, 32, 48, 64, 96, 128, 256};
+static const int Kc_Sizes[] = {64, 96, 128, 192, 256, 384};
+static const int Mc_Sizes[] = {48, 72, 96, 144, 192, 288};
+static const int Nc_Sizes[] = {512, 1024, 2048, 4096, 8192};
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+typedef struct tune_bench_t {
+    int n, bs;
+    double *A, *B, *C;
+} TuneBench;
+
+static void reset_c(void *p) {
+    TuneBench *t = p;
+    zero(t->n, t->C);
+}
+
+static void run_matmult_bl(void *p) {
+    TuneBench *t = p;
+    matmult_bl(t->n, t->bs, t->A, t->B, t->C);
+}
+
+static void run_transpose_bl(void *p) {
+    TuneBench *t = p;
+    transpose_bl(t->n, t->bs, t->A, t->C);
+}
+
+static void run_packed(void *p) {
+    TuneBench *t = p;
+    matmult_packed(t->n, t->A, t->B, t->C);
+}
+
+/*
+ * The block size from Block_Sizes (up to n) with the lowest median time for `run`
+ * on n x n matrices, with one line per candidate.
+ */
+static int best_block(const char *name, BenchFn run, BenchFn reset, TuneBench *t, Args args, int reps) {
+    long long best_time = 0;
+    int best = 0;
+
+    for (int b = 0; b < COUNT(Block_Sizes) && (Block_Sizes[b] <= t->n || b == 0); b++) {
+        t->bs = Block_Sizes[b];
+        BenchStats s = bench_run(run, reset, t, args.warmup, reps);
+
+        printf("  %-12s n = %5d  block = %3d  median = %10.3f ms\n", name, t->n, t->bs, s.median / 1e6);
+        if (!best || s.median < best_time) {
+            best = t->bs;
+            best_time = s.median;
+        }
+    }
+    return best;
+} // best_block
+
+/*
+ * One coordinate of the tile search:  tries each of the `count` values for *field
+ * (with the other two tiles held where they are), leaves the fastest in place, and
+ * returns it.
+ */
+static int best_tile(const char *name, int *field, const int *values, int count, TuneBench *t, Args args,
+                     int reps) {
+    long long best_time = 0;
+    int best = *field;
+
+    for (int v = 0; v < count; v++) {
+        *field = values[v];
+        BenchStats s = bench_run(run_packed, reset_c, t, args.warmup, reps);
+
+        printf("  %s = %4d  (kc %d, mc %d, nc %d)  median = %10.3f ms\n", name, values[v], Tile_Sizes.kc,
+               Tile_Sizes.mc, Tile_Sizes.nc, s.median / 1e6);
+        if (v == 0 || s.median < best_time) {
+            best = values[v];
+            best_time = s.median;
+        }
+    }
+    *field = best;
+    return best;
+} // best_tile
+
+int main(int argc, char **argv) {
+    Args args = get_args(argc, argv);
+    int n_min = args.n, n_max = (optind + 1 < argc) ? atoi(argv[optind + 1]) : n_min;
+    int reps = (args.reps > TUNE_REPS) ? args.reps : TUNE_REPS;
+    const char *path = tune_profile_path();
+    TuneProfile P = Tune_Profile; // Merge into what's there already
+    TuneBench t;
+
+    if (n_max < n_min) {
+        fprintf(stderr, "Bad dimension range %d .. %d.\n", n_min, n_max);
+        printUsage(argv[0]);
+        exit(0);
+    }
+
+    t.A = make_one_matrix(n_max);
+    t.B = make_one_matrix(n_max);
+    t.C = make_one_matrix(n_max);
+
+    printf("Block sizes (median of %d runs each)\n", reps);
+    printf("---------------------------------------------------------\n");
+    for (int n = n_min;; n = (2 * n < n_max) ? 2 * n : n_max) {
+        t.n = n;
+        int bl = best_block("matmult_bl", run_matmult_bl, reset_c, &t, args, reps);
+        int tr = best_block("transpose_bl", run_transpose_bl, NULL, &t, args, reps);
+
+        printf("  n = %5d:  best matmult_bl block = %d, transpose_bl block = %d\n", n, bl, tr);
+        if (!tune_set(&P, TUNE_MATMULT_BL, n, bl) || !tune_set(&P, TUNE_TRANSPOSE_BL, n, tr)) {
+            fprintf(stderr, "The profile holds at most %d sizes; stopping at n = %d.\n", TUNE_MAX_SIZES, n);
+            break;
+        }
+        if (n == n_max) break;
+    }
+    printf("---------------------------------------------------------\n\n");
+
+    // One cache level at a time, innermost first:  kc for L1, mc for L2, nc for L3
+    t.n = n_max;
+    printf("Cache tiles for matmult_packed, n = %d\n", n_max);
+    printf("---------------------------------------------------------\n");
+    best_tile("kc", &Tile_Sizes.kc, Kc_Sizes, COUNT(Kc_Sizes), &t, args, reps);
+    best_tile("mc", &Tile_Sizes.mc, Mc_Sizes, COUNT(Mc_Sizes), &t, args, reps);
+    best_tile("nc", &Tile_Sizes.nc, Nc_Sizes, COUNT(Nc_Sizes), &t, args, reps);
+    P.have_tiles = true;
+    P.tiles = Tile_Sizes;
+    printf("  best:  kc = %d, mc = %d, nc = %d\n", P.tiles.kc, P.tiles.mc, P.tiles.nc);
+    printf("---------------------------------------------------------\n\n");
+
+    if (!path) {
+        printf("(%s; nothing saved)\n",
+               (getenv("CACHEBLOCK_PROFILE") ? "profiles are turned off by CACHEBLOCK_PROFILE"
+                                             : "no $HOME to keep the profile in"));
+    } else if (tune_save(path, &P)) {
+        perror(path);
+    } else {
+        printf("Saved the profile to %s\n", path);
+    }
+
+    matrix_free(t.A);
+    matrix_free(t.B);
+    matrix_free(t.C);
+    return 0;
+} // main
@@ -0,0 +1,121 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "bench.h"
+#include "helpers.h"
+
+// Flush buffer size when the LLC size can't be read from sysconf
+#define FLUSH_DEFAULT (64L << 20)
+
+// Where bench_flush_caches leaves its sum, so the reads can't be optimized away
+static volatile char Flush_Sink;
+
+static const char *Format_Names[BENCH_FORMATS] = {"console", "csv", "json"};
+
+static int compare_ll(const void *x, const void *y) {
+    long long a = *(const long long *)x, b = *(const long long *)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Evicts the matrices of the previous run from the caches, so each timed run
+ * starts cold, as the first one would:  writes, then reads, a buffer twice the
+ * size of the last-level cache.  The buffer is allocated on first use and kept.
+ */
+void bench_flush_caches(void) {
+    static char *buf;
+    static long len;
+
+    if (!buf) {
+        long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+        len = 2 * (llc > 0 ? llc : FLUSH_DEFAULT);
+        buf = matrix_alloc(len);
+    }
+    memset(buf, 1, len);
+
+    char sum = 0;
+    for (long i = 0; i < len; i += 64) {
+        sum += buf[i];
+    }
+    Flush_Sink = sum;
+} // bench_flush_caches
+
+/*
+ * Runs `run` on ctx `warmup` times untimed, then `reps` (at least 1) times timed,
+ * and summarizes the timed runs.  Before every run, `reset` (if not NULL) puts the
+ * output back in its initial state (zeroing C, for instance) and the caches are
+ * flushed; neither is timed.  p95 is the nearest-rank 95th percentile, so it's the
+ * maximum for fewer than 20 repetitions.
+ */
+BenchStats bench_run(BenchFn run, BenchFn reset, void *ctx, int warmup, int reps) {
+    BenchStats stats = {.reps = reps > 0 ? reps : 1};
+    long long *times = malloc(stats.reps * sizeof(long long));
+
+    for (int r = 0; r < warmup; r++) {
+        if (reset) reset(ctx);
+        run(ctx);
+    }
+    for (int r = 0; r < stats.reps; r++) {
+        if (reset) reset(ctx);
+        bench_flush_caches();
+
+        long long start = timeInNanoseconds();
+        run(ctx);
+        times[r] = timeInNanoseconds() - start;
+    }
+
+    qsort(times, stats.reps, sizeof(long long), compare_ll);
+    stats.min = times[0];
+    stats.median = (stats.reps % 2) ? times[stats.reps / 2]
+                                    : (times[stats.reps / 2 - 1] + times[stats.reps / 2]) / 2;
+    stats.p95 = times[(stats.reps * 95 + 99) / 100 - 1];
+    free(times);
+    return stats;
+} // bench_run
+
+/*
+ * The BenchFormat named by s, or -1 if there is none.
+ */
+BenchFormat bench_format_parse(const char *s) {
+    for (BenchFormat f = 0; f < BENCH_FORMATS; f++) {
+        if (!strcmp(s, Format_Names[f])) return f;
+    }
+    return -1;
+} // bench_format_parse
+
+/*
+ * Starts the structured output:  the column names, for CSV.
+ */
+void bench_emit_header(FILE *out, BenchFormat format) {
+    if (format == BENCH_CSV) {
+        fprintf(out, "program,variant,n,blocksz,threads,simd,reps,min_ns,median_ns,p95_ns,gflops,gbs\n");
+    }
+} // bench_emit_header
+
+/*
+ * Writes one record.  The rates, gflops and gbs, are taken at the median time, and
+ * are 0 where the record's flops or bytes are.
+ */
+void bench_emit(FILE *out, BenchFormat format, const BenchRecord *rec) {
+    const BenchStats *s = &rec->stats;
+    double gflops = (s->median > 0) ? rec->flops / s->median : 0.0;
+    double gbs = (s->median > 0) ? rec->bytes / s->median : 0.0;
+
+    if (format == BENCH_CSV) {
+        fprintf(out, "%s,%s,%d,%d,%d,%s,%d,%lld,%lld,%lld,%.4f,%.4f\n", rec->program, rec->variant, rec->n,
+                rec->blocksz, rec->threads, rec->simd, s->reps, s->min, s->median, s->p95, gflops, gbs);
+    } else if (format == BENCH_JSON) {
+        fprintf(out,
+                "{\"program\": \"%s\", \"variant\": \"%s\", \"n\": %d, \"blocksz\": %d, \"threads\": %d, "
+                "\"simd\": \"%s\", \"reps\": %d, \"min_ns\": %lld, \"median_ns\": %lld, \"p95_ns\": %lld, "
+                "\"gflops\": %.4f, \"gbs\": %.4f}\n",
+                rec->program, rec->variant, rec->n, rec->blocksz, rec->threads, rec->simd, s->reps, s->min,
+                s->median, s->p95, gflops, gbs);
+    }
+    fflush(out);
+} // bench_emit
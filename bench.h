@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// How the drivers report:  the console tables, or one structured record per variant
+typedef enum bench_format_t {
+    BENCH_CONSOLE,
+    BENCH_CSV,  // a header line, then one comma-separated line per record
+    BENCH_JSON, // one JSON object per line (JSON Lines)
+    BENCH_FORMATS
+} BenchFormat;
+
+// One run of a kernel, or the (untimed) setup before one
+typedef void (*BenchFn)(void *ctx);
+
+// Summary of the timed repetitions of one variant, in nanoseconds
+typedef struct bench_stats_t {
+    int reps;
+    long long min, median, p95;
+} BenchStats;
+
+// One line of structured output
+typedef struct bench_record_t {
+    const char *program; // "matmult", "transpose", ...
+    const char *variant; // kernel name, as accepted by -k
+    int n, blocksz, threads;
+    const char *simd;    // Simd.name
+    BenchStats stats;
+    double flops;        // floating-point operations per run (0 if none)
+    double bytes;        // nominal bytes moved per run (0 if not meaningful)
+} BenchRecord;
+
+BenchStats bench_run(BenchFn run, BenchFn reset, void *ctx, int warmup, int reps);
+void bench_flush_caches(void);
+
+BenchFormat bench_format_parse(const char *);
+void bench_emit_header(FILE *, BenchFormat);
+void bench_emit(FILE *, BenchFormat, const BenchRecord *);
+
+#endif
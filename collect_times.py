@@ -7,7 +7,7 @@ import argparse
 import subprocess
 import shlex
 import os
-import re
+import io
 import csv
 
 
@@ -17,73 +17,81 @@ RV = ["docker", "run", "-i", "--rm", "-v", f"{os.getcwd()}:/root",
       "ghcr.io/sampsyo/cs3410-infra"]
 
 
-def get_stats(log, key):
-    """Extract the running time for a given configuration from the
-    output of a `matmult` execution.
+def parse_records(log):
+    """Read the records of a `matmult -o csv` execution.
 
-    We assume that the value appears directly after the `=` symbol (and
-    possibly some whitespace. The output looks like this:
+    The driver prints a header line, then one line per kernel variant:
 
-        TIME TO COMPLETION (blocked) = 66 msec.
+        program,variant,n,blocksz,threads,simd,reps,min_ns,median_ns,...
+        matmult,blocked,256,32,1,avx512,5,727678,1052455,...
 
-    Here, we would return the value `66` if the key is `(blocked)`.
+    Return them as a list of dicts, keyed by the column names.
     """
+    return list(csv.DictReader(io.StringIO(log)))
 
-    for line in log.split('\n'):
-        if key in line.split():
-            match = re.search(r'=\s*(\d+)', line)
-            assert match
-            return float(match.group(1))
-    return 0.0
 
-
-def run_exp(mat_size, emulation=True):
+def run_exp(mat_size, block_size, kernel, reps, warmup, emulation=True):
     """Run a single experiment, using a pre-built executable.
 
-    Execute the `matmult` binary with the given matrix size. Return the
-    full standard output from the command.
+    Execute the `matmult` binary with the given matrix and block size,
+    asking for `reps` timed runs (after `warmup` untimed ones) of just
+    `kernel`, in CSV.  Return the full standard output from the command.
     """
+    args = ["-o", "csv", "-k", kernel, "-r", str(reps), "-w", str(warmup),
+            "-b", str(block_size), str(mat_size)]
     if emulation:
-        cmd = RV + ["qemu", "matmult", str(mat_size)]
+        cmd = RV + ["qemu", "matmult"] + args
     else:
-        cmd = ["./matmult", str(mat_size)]
+        cmd = ["./matmult"] + args
     print(shlex.join(cmd))
     proc = subprocess.run(cmd, stdout=subprocess.PIPE)
     return proc.stdout.decode()
 
 
-def collect_times(matrix_sizes, block_sizes, emulation=True):
+def collect_times(matrix_sizes, block_sizes, emulation=True,
+                  kernel='blocked', reps=5, warmup=1):
     """Run a series of experiments for different matrix and block sizes.
 
-    Generate (matrix size, block size, running time) tuples.
+    Generate (matrix size, block size, median, min, p95) tuples, with the
+    times in milliseconds, for the `matmult` variant `kernel` (e.g.
+    `blocked`, `tiled` or `packed`).
     """
-    # For each block size choice, we'll need to re-compile:
-    for block_size in block_sizes:
-        subprocess.run(["make", "clean"])
+    # The block size is a runtime argument, so one build covers the sweep.
+    subprocess.run(["make", "clean"])
 
-        make_cmd = ["make", "matmult", f"BLOCK={block_size}"]
-        if emulation:
-            make_cmd = RV + make_cmd
-        subprocess.run(make_cmd)
+    make_cmd = ["make", "matmult"]
+    if emulation:
+        make_cmd = RV + make_cmd
+    subprocess.run(make_cmd)
 
-        # Now run the resulting executable for this block size on the
-        # various choices of matrix size.
+    for block_size in block_sizes:
+        # Run the executable for this block size on the various choices
+        # of matrix size.
         for mat_size in matrix_sizes:
             if mat_size >= block_size:
                 # Skip cases where block size is too big.
-                log = run_exp(mat_size, emulation)
-                time = get_stats(log, '(blocked)')
-                yield mat_size, block_size, time
+                log = run_exp(mat_size, block_size, kernel, reps, warmup,
+                              emulation)
+                records = parse_records(log)
+                assert len(records) == 1, f"no '{kernel}' record in output"
+                rec = records[0]
+                yield (mat_size, block_size,
+                       int(rec["median_ns"]) / 1e6,
+                       int(rec["min_ns"]) / 1e6,
+                       int(rec["p95_ns"]) / 1e6)
 
 
 def emit_csv(runtimes, filename):
     """Generate a CSV with the data returned from `collect_times`.
+
+    `time` is the median, so the plots read it as before; `min` and
+    `p95` give the spread.
     """
     with open(filename, 'w') as f:
         writer = csv.writer(f)
-        writer.writerow(["matrix size", "block size", "time"])
-        for mat_size, block_size, time in runtimes:
-            writer.writerow([mat_size, block_size, time])
+        writer.writerow(["matrix size", "block size", "time", "min", "p95"])
+        for row in runtimes:
+            writer.writerow(row)
 
 
 if __name__ == '__main__':
@@ -94,11 +102,21 @@ if __name__ == '__main__':
                         help='Comma-separated list of matrix sizes')
     parser.add_argument('--block-sizes', '-b', required=True,
                         help='Comma-separated list of block sizes')
+    parser.add_argument('--kernel', '-k', default='blocked',
+                        help='Which matmult variant to record (default: '
+                        'blocked)')
+    parser.add_argument('--reps', '-r', type=int, default=5,
+                        help='Timed runs per configuration (default: 5)')
+    parser.add_argument('--warmup', '-w', type=int, default=1,
+                        help='Untimed runs before those (default: 1)')
     args = parser.parse_args()
 
     runtimes = collect_times(
         [int(s) for s in args.matrix_sizes.split(",")],
         [int(s) for s in args.block_sizes.split(",")],
         not args.native,
+        args.kernel,
+        args.reps,
+        args.warmup,
     )
     emit_csv(runtimes, "runtimes.csv")
@@ -0,0 +1,356 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csr.h"
+#include "simd.h"
+#include "threads.h"
+
+/*
+ * Converts the dense, row-major n x n matrix M into S, keeping the nonzeros (in
+ * two passes:  one to count them, one to copy them).  Release S with csr_free.
+ */
+void csr_from_dense(int n, double *M, CsrMatrix *S) {
+    long nnz = 0;
+
+    for (long i = 0; i < (long)n * n; i++) {
+        nnz += (M[i] != 0.0);
+    }
+
+    S->n = n;
+    S->nnz = nnz;
+    S->row_ptr = malloc((n + 1) * sizeof(long));
+    S->col = malloc((nnz ? nnz : 1) * sizeof(int));
+    S->val = malloc((nnz ? nnz : 1) * sizeof(double));
+
+    long p = 0;
+    for (int i = 0; i < n; i++) {
+        S->row_ptr[i] = p;
+        for (int j = 0; j < n; j++) {
+            if (M[(long)i * n + j] != 0.0) {
+                S->col[p] = j;
+                S->val[p] = M[(long)i * n + j];
+                p++;
+            }
+        }
+    }
+    S->row_ptr[n] = p;
+} // csr_from_dense
+
+/*
+ * The inverse of csr_from_dense:  writes S into the dense n x n matrix M, zeros
+ * included.
+ */
+void csr_to_dense(CsrMatrix *S, double *M) {
+    int n = S->n;
+
+    memset(M, 0, (size_t)n * n * sizeof(double));
+    for (int i = 0; i < n; i++) {
+        for (long p = S->row_ptr[i]; p < S->row_ptr[i + 1]; p++) {
+            M[(long)i * n + S->col[p]] = S->val[p];
+        }
+    }
+} // csr_to_dense
+
+void csr_free(CsrMatrix *S) {
+    free(S->row_ptr);
+    free(S->col);
+    free(S->val);
+    S->row_ptr = NULL;
+    S->col = NULL;
+    S->val = NULL;
+} // csr_free
+
+/*
+ * Marks in `used` (nb flags) the tiles of block row ib of the n x n matrix M that
+ * hold a nonzero, and returns how many there are.
+ */
+static int bsr_mark_row(int n, int bs, int nb, double *M, int ib, bool *used) {
+    int count = 0;
+
+    memset(used, 0, nb * sizeof(bool));
+    for (int i = ib * bs; i < (ib + 1) * bs && i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (M[(long)i * n + j] != 0.0 && !used[j / bs]) {
+                used[j / bs] = true;
+                count++;
+            }
+        }
+    }
+    return count;
+} // bsr_mark_row
+
+/*
+ * Converts the dense, row-major n x n matrix M into S, in tiles of side bs (<= 0
+ * selects BSR_BLOCK), keeping each tile with a nonzero.  Release S with bsr_free.
+ */
+void bsr_from_dense(int n, int bs, double *M, BsrMatrix *S) {
+    if (bs <= 0) bs = BSR_BLOCK;
+
+    int nb = (n + bs - 1) / bs;
+    bool *used = malloc(nb * sizeof(bool));
+    long nnzb = 0;
+
+    S->n = n;
+    S->bs = bs;
+    S->nb = nb;
+    S->row_ptr = malloc((nb + 1) * sizeof(long));
+    for (int ib = 0; ib < nb; ib++) {
+        S->row_ptr[ib] = nnzb;
+        nnzb += bsr_mark_row(n, bs, nb, M, ib, used);
+    }
+    S->row_ptr[nb] = nnzb;
+    S->nnzb = nnzb;
+    S->col = malloc((nnzb ? nnzb : 1) * sizeof(int));
+    S->val = calloc((nnzb ? nnzb : 1) * bs * bs, sizeof(double));
+
+    for (int ib = 0; ib < nb; ib++) {
+        long t = S->row_ptr[ib];
+
+        bsr_mark_row(n, bs, nb, M, ib, used);
+        for (int jb = 0; jb < nb; jb++) {
+            if (!used[jb]) continue;
+
+            double *tile = S->val + t * bs * bs;
+            int rows = (n - ib * bs < bs) ? n - ib * bs : bs, cols = (n - jb * bs < bs) ? n - jb * bs : bs;
+
+            S->col[t++] = jb;
+            for (int r = 0; r < rows; r++) {
+                memcpy(tile + r * bs, M + (long)(ib * bs + r) * n + jb * bs, cols * sizeof(double));
+            }
+        }
+    }
+    free(used);
+} // bsr_from_dense
+
+/*
+ * The inverse of bsr_from_dense:  writes S into the dense n x n matrix M, dropping
+ * the padding.
+ */
+void bsr_to_dense(BsrMatrix *S, double *M) {
+    int n = S->n, bs = S->bs;
+
+    memset(M, 0, (size_t)n * n * sizeof(double));
+    for (int ib = 0; ib < S->nb; ib++) {
+        int rows = (n - ib * bs < bs) ? n - ib * bs : bs;
+
+        for (long t = S->row_ptr[ib]; t < S->row_ptr[ib + 1]; t++) {
+            int jb = S->col[t], cols = (n - jb * bs < bs) ? n - jb * bs : bs;
+
+            for (int r = 0; r < rows; r++) {
+                memcpy(M + (long)(ib * bs + r) * n + jb * bs, S->val + t * bs * bs + r * bs, cols * sizeof(double));
+            }
+        }
+    }
+} // bsr_to_dense
+
+void bsr_free(BsrMatrix *S) {
+    free(S->row_ptr);
+    free(S->col);
+    free(S->val);
+    S->row_ptr = NULL;
+    S->col = NULL;
+    S->val = NULL;
+} // bsr_free
+
+/*
+ * Counting sort of the entries of a CSR pattern by column:  fills t_ptr (nr + 1
+ * offsets, for nr rows of the transpose) and, for each entry p of the original,
+ * its position dest[p] in the transpose.  Walking the original in row order keeps
+ * each row of the transpose in increasing order of column.
+ */
+static void csr_transpose_pattern(int nr, long *row_ptr, int *col, long *t_ptr, long *dest) {
+    memset(t_ptr, 0, (nr + 1) * sizeof(long));
+    for (long p = 0; p < row_ptr[nr]; p++) {
+        t_ptr[col[p] + 1]++;
+    }
+    for (int j = 0; j < nr; j++) {
+        t_ptr[j + 1] += t_ptr[j];
+    }
+
+    long *next = malloc((nr + 1) * sizeof(long));
+    memcpy(next, t_ptr, (nr + 1) * sizeof(long));
+    for (long p = 0; p < row_ptr[nr]; p++) {
+        dest[p] = next[col[p]]++;
+    }
+    free(next);
+} // csr_transpose_pattern
+
+/*
+ * S_t = S', as a new CSR matrix (release it with csr_free).  The transpose is one
+ * counting sort of S's nonzeros by column, in O(n + nnz) time, without touching
+ * the zeros a dense transpose_bl has to move.
+ */
+void csr_transpose(CsrMatrix *S, CsrMatrix *S_t) {
+    int n = S->n;
+    long nnz = S->nnz, *dest = malloc((nnz ? nnz : 1) * sizeof(long));
+
+    S_t->n = n;
+    S_t->nnz = nnz;
+    S_t->row_ptr = malloc((n + 1) * sizeof(long));
+    S_t->col = malloc((nnz ? nnz : 1) * sizeof(int));
+    S_t->val = malloc((nnz ? nnz : 1) * sizeof(double));
+
+    csr_transpose_pattern(n, S->row_ptr, S->col, S_t->row_ptr, dest);
+    for (int i = 0; i < n; i++) {
+        for (long p = S->row_ptr[i]; p < S->row_ptr[i + 1]; p++) {
+            S_t->col[dest[p]] = i;
+            S_t->val[dest[p]] = S->val[p];
+        }
+    }
+    free(dest);
+} // csr_transpose
+
+/*
+ * S_t = S', as a new BSR matrix with the same block size (release it with
+ * bsr_free):  the tile pattern is transposed as in csr_transpose, and each stored
+ * tile is transposed into its new place.
+ */
+void bsr_transpose(BsrMatrix *S, BsrMatrix *S_t) {
+    int nb = S->nb, bs = S->bs;
+    long nnzb = S->nnzb, *dest = malloc((nnzb ? nnzb : 1) * sizeof(long));
+
+    S_t->n = S->n;
+    S_t->bs = bs;
+    S_t->nb = nb;
+    S_t->nnzb = nnzb;
+    S_t->row_ptr = malloc((nb + 1) * sizeof(long));
+    S_t->col = malloc((nnzb ? nnzb : 1) * sizeof(int));
+    S_t->val = malloc((nnzb ? nnzb : 1) * bs * bs * sizeof(double));
+
+    csr_transpose_pattern(nb, S->row_ptr, S->col, S_t->row_ptr, dest);
+    for (int ib = 0; ib < nb; ib++) {
+        for (long t = S->row_ptr[ib]; t < S->row_ptr[ib + 1]; t++) {
+            double *src = S->val + t * bs * bs, *dst = S_t->val + dest[t] * bs * bs;
+
+            S_t->col[dest[t]] = ib;
+            for (int r = 0; r < bs; r++) {
+                for (int c = 0; c < bs; c++) {
+                    dst[c * bs + r] = src[r * bs + c];
+                }
+            }
+        }
+    }
+    free(dest);
+} // bsr_transpose
+
+/*
+ * Rows [first, last) of C += S * B, one column panel of B and C at a time:  for
+ * each nonzero S[i][k], row k of B's panel is added (Simd.axpy) into row i of C's,
+ * so the panel of C's row stays in L1 while it accumulates, and the panel of B is
+ * reused by every row in the range.
+ */
+static void spmm_csr_rows(CsrMatrix *S, int panel, double *B, double *C, int first, int last) {
+    int n = S->n;
+
+    for (int jc = 0; jc < n; jc += panel) {
+        int w = (n - jc < panel) ? n - jc : panel;
+
+        for (int i = first; i < last; i++) {
+            double *c = C + (long)i * n + jc;
+
+            for (long p = S->row_ptr[i]; p < S->row_ptr[i + 1]; p++) {
+                Simd.axpy(w, S->val[p], B + (long)S->col[p] * n + jc, c);
+            }
+        }
+    }
+} // spmm_csr_rows
+
+/*
+ * Block rows [first, last) of C += S * B, as in spmm_csr_rows, one stored tile at
+ * a time:  each of its bs x bs values adds a row of B's panel into a row of C's.
+ * The padding outside the matrix is skipped.
+ */
+static void spmm_bsr_rows(BsrMatrix *S, int panel, double *B, double *C, int first, int last) {
+    int n = S->n, bs = S->bs;
+
+    for (int jc = 0; jc < n; jc += panel) {
+        int w = (n - jc < panel) ? n - jc : panel;
+
+        for (int ib = first; ib < last; ib++) {
+            int i0 = ib * bs, rows = (n - i0 < bs) ? n - i0 : bs;
+
+            for (long t = S->row_ptr[ib]; t < S->row_ptr[ib + 1]; t++) {
+                int k0 = S->col[t] * bs, cols = (n - k0 < bs) ? n - k0 : bs;
+                double *tile = S->val + t * bs * bs;
+
+                for (int r = 0; r < rows; r++) {
+                    double *c = C + (long)(i0 + r) * n + jc;
+
+                    for (int k = 0; k < cols; k++) {
+                        if (tile[r * bs + k] != 0.0) {
+                            Simd.axpy(w, tile[r * bs + k], B + (long)(k0 + k) * n + jc, c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+} // spmm_bsr_rows
+
+/*
+ * C += S * B, for the sparse n x n matrix S and dense, row-major n x n matrices B
+ * and C.  The work is proportional to the nonzeros of S times n, not n^3.  B and
+ * C are walked in column panels `panel` wide (<= 0 selects CSR_PANEL), the
+ * cache-blocking of the dense operand.
+ *
+ * PRECONDITIONS:  C is initialized to zero (or holds what the product is added to).
+ */
+void spmm_csr(CsrMatrix *S, int panel, double *B, double *C) {
+    if (panel <= 0) panel = CSR_PANEL;
+
+    spmm_csr_rows(S, panel, B, C, 0, S->n);
+} // spmm_csr
+
+/*
+ * spmm_csr for a BSR matrix.  Within a stored tile, zero values are skipped, so a
+ * nearly empty tile costs little more than its nonzeros.
+ */
+void spmm_bsr(BsrMatrix *S, int panel, double *B, double *C) {
+    if (panel <= 0) panel = CSR_PANEL;
+
+    spmm_bsr_rows(S, panel, B, C, 0, S->nb);
+} // spmm_bsr
+
+typedef struct spmm_job_t {
+    CsrMatrix *csr;
+    BsrMatrix *bsr;
+    int panel, rows; // rows (or block rows) per tile
+    double *B, *C;
+} SpmmJob;
+
+static void spmm_job_tile(void *ctx, int tile) {
+    SpmmJob *job = ctx;
+    int first = tile * job->rows;
+
+    if (job->csr) {
+        int last = (first + job->rows < job->csr->n) ? first + job->rows : job->csr->n;
+        spmm_csr_rows(job->csr, job->panel, job->B, job->C, first, last);
+    } else {
+        int last = (first + job->rows < job->bsr->nb) ? first + job->rows : job->bsr->nb;
+        spmm_bsr_rows(job->bsr, job->panel, job->B, job->C, first, last);
+    }
+} // spmm_job_tile
+
+/*
+ * spmm_csr on `nthreads` threads (<= 0 means one per online CPU).  The rows of S
+ * (and so of C) are split into runs of CSR_ROWS, scheduled by work stealing (see
+ * run_tiles_ws), since the nonzeros per row may be very uneven.  Each row of C is
+ * written by one thread, in the same order as by spmm_csr, so the result is
+ * bit-for-bit identical.
+ */
+void spmm_csr_mt(CsrMatrix *S, int panel, int nthreads, double *B, double *C) {
+    SpmmJob job = {.csr = S, .panel = (panel > 0 ? panel : CSR_PANEL), .rows = CSR_ROWS, .B = B, .C = C};
+
+    run_tiles_ws(nthreads, (S->n + CSR_ROWS - 1) / CSR_ROWS, spmm_job_tile, &job);
+} // spmm_csr_mt
+
+/*
+ * spmm_bsr on `nthreads` threads, split by block rows as spmm_csr_mt splits rows.
+ */
+void spmm_bsr_mt(BsrMatrix *S, int panel, int nthreads, double *B, double *C) {
+    int rows = (CSR_ROWS + S->bs - 1) / S->bs;
+    SpmmJob job = {.bsr = S, .panel = (panel > 0 ? panel : CSR_PANEL), .rows = rows, .B = B, .C = C};
+
+    run_tiles_ws(nthreads, (S->nb + rows - 1) / rows, spmm_job_tile, &job);
+} // spmm_bsr_mt
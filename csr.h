@@ -0,0 +1,60 @@
+#ifndef CSR_H
+#define CSR_H
+
+// Columns of B and C per panel in the sparse multiplies, when no width is given:
+// a panel of a few thousand rows of B then stays in L2/L3 while every row of the
+// sparse matrix streams past it.
+#define CSR_PANEL 256
+
+// Rows (for BSR, rounded up to whole block rows) per unit of work in the
+// multithreaded sparse kernels
+#define CSR_ROWS 32
+
+// Block side for BSR matrices when the drivers aren't given one
+#define BSR_BLOCK 8
+
+/*
+ * Compressed sparse row storage of an n x n matrix:  only the nonzeros are kept,
+ * row by row.  Row i's nonzeros are entries [row_ptr[i], row_ptr[i + 1]) of col
+ * and val, in increasing order of column.
+ */
+typedef struct csr_matrix_t {
+    int n;
+    long nnz;
+    long *row_ptr; // n + 1 offsets into col and val
+    int *col;      // column of each nonzero
+    double *val;   // value of each nonzero
+} CsrMatrix;
+
+/*
+ * Blocked CSR (BSR):  CSR over the nb x nb grid of bs x bs tiles of an n x n
+ * matrix, keeping every tile that holds a nonzero.  Block row ib's tiles are
+ * entries [row_ptr[ib], row_ptr[ib + 1]) of col, and tile t is the bs x bs
+ * row-major block at val + t * bs * bs.  Tiles on the bottom and right edges are
+ * padded with zeros, as in tile-major storage (see layout.h).
+ */
+typedef struct bsr_matrix_t {
+    int n, bs, nb; // nb = ceil(n / bs)
+    long nnzb;     // stored tiles
+    long *row_ptr; // nb + 1 offsets into col, in tiles
+    int *col;      // block column of each stored tile
+    double *val;   // nnzb tiles of bs * bs values
+} BsrMatrix;
+
+void csr_from_dense(int n, double *M, CsrMatrix *S);
+void csr_to_dense(CsrMatrix *S, double *M);
+void csr_free(CsrMatrix *S);
+
+void bsr_from_dense(int n, int bs, double *M, BsrMatrix *S);
+void bsr_to_dense(BsrMatrix *S, double *M);
+void bsr_free(BsrMatrix *S);
+
+void csr_transpose(CsrMatrix *S, CsrMatrix *S_t);
+void bsr_transpose(BsrMatrix *S, BsrMatrix *S_t);
+
+void spmm_csr(CsrMatrix *S, int panel, double *B, double *C);
+void spmm_csr_mt(CsrMatrix *S, int panel, int nthreads, double *B, double *C);
+void spmm_bsr(BsrMatrix *S, int panel, double *B, double *C);
+void spmm_bsr_mt(BsrMatrix *S, int panel, int nthreads, double *B, double *C);
+
+#endif
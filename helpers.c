@@ -1,39 +1,206 @@
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "alloc.h"
 #include "helpers.h"
+#include "placement.h"
+#include "simd.h"
+#include "threads.h"
+#include "tune.h"
 
 void printUsage(char *progname) {
-    fprintf(stderr, "USAGE:  %s <dimension> \n", progname);
+    fprintf(stderr, "USAGE:  %s [-b <block size>] [-t <threads>] [-T <type>] [-N] [-w <n>] [-r <n>] [-o <format>] "
+                    "[-k <variant>] <dimension> \n", progname);
     fprintf(stderr, "<dimension> must be a positive integer.\n");
+    fprintf(stderr, "<block size> must be a positive integer (default: the tuned size, else %d).\n", BLOCKSZ);
+    fprintf(stderr, "<threads> must be a positive integer (default: one per CPU).\n");
+    fprintf(stderr, "<type> is the element type:  double (default), float, int32 or int8.\n");
+    fprintf(stderr, "-N pins threads and places matrices for NUMA locality.\n");
+    fprintf(stderr, "Benchmark harness:  [-w <warmup runs>] [-r <timed runs>] [-o csv|json] [-k <variant>]\n");
+    fprintf(stderr, "-o writes one record per variant (min/median/p95 over the -r runs) instead of the tables.\n");
 } // printUsage
 
 /*
- * Reads command line arguments for the matrix row/column dimension and the
- * block size to use.  If there are fewer than two command line arguments or
- * if the arguments are not positive integers, the program exits with a use
- * message;
+ * Reads command line arguments for the matrix row/column dimension, the block
+ * size and the thread count to use.  If the dimension is missing or if any
+ * argument is not a positive integer, the program exits with a use message.  The
+ * block size is optional, and defaults to 0, which the blocked kernels read as
+ * this host's tuned size (see tune.h), else the compile-time BLOCKSZ; the thread
+ * count defaults to 0, which the parallel kernels read as one thread per CPU,
+ * and the element type (see typed.h) to double.  -N turns on NUMA placement (see
+ * placement.h), both in the result and in Numa_Placement itself, so that it is
+ * in effect for every matrix the program allocates afterwards.  -w, -r, -o and -k
+ * configure the benchmark harness (see bench.h); -o is what switches it on.
  */
-int get_arg(int argc, char **argv) {
+Args get_args(int argc, char **argv) {
+    Args args = {.n = 0, .blocksz = 0, .threads = 0, .type = ELEM_F64, .numa = false,
+                 .warmup = 0, .reps = 1, .format = BENCH_CONSOLE, .kernel = NULL};
+    int opt;
 
-    if (argc < 2) {
+    while ((opt = getopt(argc, argv, "b:t:T:Nw:r:o:k:")) != -1) {
+        switch (opt) {
+        case 'b':
+            args.blocksz = atoi(optarg);
+            if (args.blocksz <= 0) {
+                fprintf(stderr, "Bad block size value %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            break;
+        case 't':
+            args.threads = atoi(optarg);
+            if (args.threads <= 0) {
+                fprintf(stderr, "Bad thread count %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            break;
+        case 'T': {
+            int type = elem_parse(optarg);
+            if (type < 0) {
+                fprintf(stderr, "Bad element type %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            args.type = type;
+            break;
+        }
+        case 'N':
+            args.numa = Numa_Placement = true;
+            break;
+        case 'w':
+            args.warmup = atoi(optarg);
+            if (args.warmup < 0 || (args.warmup == 0 && strcmp(optarg, "0"))) {
+                fprintf(stderr, "Bad warmup count %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            break;
+        case 'r':
+            args.reps = atoi(optarg);
+            if (args.reps <= 0) {
+                fprintf(stderr, "Bad repetition count %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            break;
+        case 'o':
+            if (bench_format_parse(optarg) < 0) {
+                fprintf(stderr, "Bad output format %s.\n", optarg);
+                printUsage(argv[0]);
+                exit(0);
+            }
+            args.format = bench_format_parse(optarg);
+            break;
+        case 'k':
+            args.kernel = optarg;
+            break;
+        default:
+            printUsage(argv[0]);
+            exit(0);
+        }
+    }
+
+    if (optind >= argc) {
         printUsage(argv[0]);
         exit(0);
     }
 
-    int dimension = atoi(argv[1]); // row & column count
+    args.n = atoi(argv[optind]); // row & column count
 
-    if (!dimension) {
-        fprintf(stderr, "Bad dimension value %s.\n", argv[1]);
+    if (args.n <= 0) {
+        fprintf(stderr, "Bad dimension value %s.\n", argv[optind]);
         printUsage(argv[0]);
         exit(0);
     }
 
-    return dimension;
-} // get_arg
+    return args;
+} // get_args
+
+/*
+ * The block (or tile) size for the test drivers' checks of the tiled kernels:  the
+ * one -b gives, else n / 3 + 2, which doesn't divide n, so that the ragged tiles
+ * on the bottom and right edges get tested too.
+ */
+int ragged_block(Args args, int n) {
+    return (args.blocksz > 1) ? args.blocksz : n / 3 + 2;
+} // ragged_block
+
+_Static_assert(FILL_CHUNK * sizeof(double) == HUGE_PAGE, "fill ranges must match matrix_first_touch's");
+
+// Work for fill_tile:  M[i] = start + step * i, for 0 <= i < count
+typedef struct fill_job_t {
+    double *M;
+    size_t count;
+    size_t skew; // elements from the HUGE_PAGE boundary at or before M to M
+    double start, step;
+    bool stream; // non-temporal stores
+} FillJob;
+
+static void fill_tile(void *ctx, int tile) {
+    FillJob *job = ctx;
+    double *M = job->M, start = job->start, step = job->step;
+    size_t i = (tile ? (size_t)tile * FILL_CHUNK - job->skew : 0);
+    size_t last = (size_t)(tile + 1) * FILL_CHUNK - job->skew;
+
+    if (last > job->count) last = job->count;
+
+    // One at a time up to a 16-byte boundary (ranges start on one, but zero and
+    // fill take any double *), then a cache line at a time from four running
+    // pairs, which stay exact while the values are integers below 2^53
+    for (; i < last && ((uintptr_t)(M + i) & 15); i++) {
+        M[i] = start + step * (double)i;
+    }
+#ifdef __SSE2__
+    __m128d v[4], inc = _mm_set1_pd(8.0 * step);
+    for (int r = 0; r < 4; r++) {
+        v[r] = _mm_set_pd(start + step * (double)(i + 2 * r + 1), start + step * (double)(i + 2 * r));
+    }
+    if (job->stream) {
+        for (; i + 8 <= last; i += 8) {
+            for (int r = 0; r < 4; r++) {
+                _mm_stream_pd(M + i + 2 * r, v[r]);
+                v[r] = _mm_add_pd(v[r], inc);
+            }
+        }
+        _mm_sfence();
+    } else {
+        for (; i + 8 <= last; i += 8) {
+            for (int r = 0; r < 4; r++) {
+                _mm_store_pd(M + i + 2 * r, v[r]);
+                v[r] = _mm_add_pd(v[r], inc);
+            }
+        }
+    }
+#endif
+    for (; i < last; i++) {
+        M[i] = start + step * (double)i;
+    }
+} // fill_tile
+
+/*
+ * M[i] = start + step * i for 0 <= i < count, in FILL_CHUNK ranges in parallel
+ * (a single range runs on the calling thread).  Exact if start and step are
+ * integers and every value stays below 2^53.
+ */
+static void fill_linear(double *M, size_t count, double start, double step) {
+    FillJob job = {.M = M, .count = count, .skew = (uintptr_t)M % HUGE_PAGE / sizeof(double), .start = start,
+                   .step = step, .stream = count * sizeof(double) >= FILL_STREAM_BYTES};
+
+    run_tiles_static(0, (int)((job.skew + count + FILL_CHUNK - 1) / FILL_CHUNK), fill_tile, &job);
+} // fill_linear
 
 /*
  * Constructs and returns a square, n x n matrix of floating point values,
@@ -44,37 +211,124 @@ int get_arg(int argc, char **argv) {
  *   7  8  9
  *
  * will be [1,2,3,4,5,6,7,8,9].  Returns the constructed matrix.
- * Note:  the result is dynamically allocated, so the caller is responsible
- * for garbage collection.
+ * Note:  the result comes from matrix_alloc (64-byte aligned, on huge pages when
+ * large enough, and first touched by all threads), so the caller is responsible
+ * for freeing it with matrix_free.
  *
  * Preconditions:  n > 0
  */
 double *make_one_matrix(int n) {
     // assert(n > 0);
 
-    double *M = (double *)malloc(n * n * sizeof(double));
-    double ct = 1;
+    size_t bytes = (size_t)n * n * sizeof(double);
+    double *M = matrix_alloc(bytes);
 
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            M[i * n + j] = ct; //(ct/100.0));  // M[i][j] = ...
-            ct++;
-        }
-    }
+    // The fill writes the same ranges on the same threads as matrix_first_touch,
+    // so it is the first touch, unless the pages must be bound to nodes first
+    if (Numa_Placement) matrix_first_touch(M, bytes, 0);
+    fill_linear(M, (size_t)n * n, 1.0, 1.0);
     return M;
 } // make_one_matrix
 
+/*
+ * Sets the value of every cell in M to v.
+ */
+void fill(int n, double *M, double v) {
+    fill_linear(M, (size_t)n * n, v, 0.0);
+} // fill
+
 /*
  * Sets the value of every cell in M to 0.0.
  */
 void zero(int n, double *M) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            M[i * n + j] = 0.0;
-        }
+    fill_linear(M, (size_t)n * n, 0.0, 0.0);
+}
+
+/*
+ * Returns the largest absolute difference between corresponding cells of the
+ * n x n matrices X and Y, i.e. 0.0 if and only if they are equal.
+ */
+double max_abs_diff(int n, double *X, double *Y) {
+    double max = 0.0;
+
+    for (int i = 0; i < n * n; i++) {
+        double d = fabs(X[i] - Y[i]);
+        if (!(d <= max)) max = d; // so a NaN anywhere makes the result NaN
     }
+    return max;
+} // max_abs_diff
+
+// Work for compare_tile:  one MatrixDiff per FILL_CHUNK range, merged afterwards
+typedef struct compare_job_t {
+    double *X, *Y;
+    size_t count;
+    MatrixDiff *parts;
+} CompareJob;
+
+/*
+ * The bits of x as an integer that orders like x itself (with -0.0 and 0.0 the
+ * same), so that the difference of two is their distance in ulps.
+ */
+static inline int64_t ordered_bits(double x) {
+    int64_t b;
+
+    memcpy(&b, &x, sizeof(b));
+    return (b < 0) ? INT64_MIN - b : b;
 }
 
+static void compare_tile(void *ctx, int tile) {
+    CompareJob *job = ctx;
+    size_t first = (size_t)tile * FILL_CHUNK;
+    size_t last = (job->count - first < FILL_CHUNK) ? job->count : first + FILL_CHUNK;
+    MatrixDiff d = {0.0, 0.0, 0, true};
+
+    for (size_t i = first; i < last; i++) {
+        double x = job->X[i], y = job->Y[i];
+        if (x == y) continue;
+
+        double abs, rel;
+        uint64_t ulp;
+        if (isfinite(x) && isfinite(y)) {
+            int64_t a = ordered_bits(x), b = ordered_bits(y);
+
+            abs = fabs(x - y);
+            rel = abs / fmax(fabs(x), fabs(y));
+            ulp = (a > b) ? (uint64_t)a - (uint64_t)b : (uint64_t)b - (uint64_t)a;
+        } else {
+            abs = rel = INFINITY;
+            ulp = UINT64_MAX;
+        }
+        if (abs > d.max_abs) d.max_abs = abs;
+        if (rel > d.max_rel) d.max_rel = rel;
+        if (ulp > d.max_ulp) d.max_ulp = ulp;
+    }
+    job->parts[tile] = d;
+} // compare_tile
+
+/*
+ * Compares the n x n matrices X and Y cell by cell, in FILL_CHUNK ranges in
+ * parallel, and returns the largest absolute, relative and ulp differences.  The
+ * result is ok when no relative difference exceeds tol:  0.0 asks for X and Y to
+ * be equal (-0.0 and 0.0 aside), and a few multiples of DBL_EPSILON allow for a
+ * kernel that sums in a different order than the reference.
+ */
+MatrixDiff matrix_compare(int n, double *X, double *Y, double tol) {
+    size_t count = (size_t)n * n;
+    int ntiles = (int)((count + FILL_CHUNK - 1) / FILL_CHUNK);
+    CompareJob job = {.X = X, .Y = Y, .count = count, .parts = malloc(ntiles * sizeof(MatrixDiff))};
+    MatrixDiff d = {0.0, 0.0, 0, true};
+
+    run_tiles_static(0, ntiles, compare_tile, &job);
+    for (int t = 0; t < ntiles; t++) {
+        if (job.parts[t].max_abs > d.max_abs) d.max_abs = job.parts[t].max_abs;
+        if (job.parts[t].max_rel > d.max_rel) d.max_rel = job.parts[t].max_rel;
+        if (job.parts[t].max_ulp > d.max_ulp) d.max_ulp = job.parts[t].max_ulp;
+    }
+    free(job.parts);
+    d.ok = d.max_rel <= tol;
+    return d;
+} // matrix_compare
+
 /*
  * Displays the total time to calculate C = A*B. If verbose is true, it will also
  * display the contents of A, B, and C
@@ -116,9 +370,108 @@ void print_results_matmult(int blocksz, MMTotals mmt) {
     printf("  TIME TO COMPLETION (realigned) = %lu msec.\n", (mmt.total_cm));
     printf("  TIME TO COMPLETION (interchange) = %lu msec.\n", (mmt.total_li));
     printf("  TIME TO COMPLETION (blocked) = %lu msec.\n", (mmt.total_bl));
+    printf("  TIME TO COMPLETION (tiled) = %lu msec.\n", (mmt.total_tiled));
+    printf("  TIME TO COMPLETION (packed) = %lu msec.\n", (mmt.total_pk));
+    printf("  TIME TO COMPLETION (recursive) = %lu msec.\n", (mmt.total_rec));
+    printf("  TIME TO COMPLETION (strassen) = %lu msec.\n", (mmt.total_sw));
+    printf("  TIME TO COMPLETION (gemm) = %lu msec.\n", (mmt.total_gemm));
     printf("---------------------------------------------------------\n\n");
 } // print_results_full
 
+/*
+ * Displays the time for one run of a multithreaded kernel, its speedup over the
+ * single-threaded run, and whether its result matched the serial kernel exactly.
+ */
+void print_results_threads(int threads, unsigned long total_one, unsigned long total, bool identical) {
+    printf("  %3d thread%s  TIME TO COMPLETION = %lu msec.  speedup = %.2fx  %s\n", threads,
+           (threads == 1 ? " " : "s"), total, (total ? (double)total_one / total : 0.0),
+           (identical ? "(bit-identical)" : "(MISMATCH)"));
+} // print_results_threads
+
+/*
+ * Displays the time for one pass that reads and writes an n x n matrix once each
+ * (a transpose, or a copy), along with the memory bandwidth that implies.  `elem`
+ * is the size of one element in bytes.
+ */
+void print_results_bandwidth(const char *label, int n, size_t elem, unsigned long total) {
+    double bytes = 2.0 * n * n * elem;
+
+    printf("  %-14s TIME TO COMPLETION = %lu msec.  ", label, total);
+    if (total) {
+        printf("%.2f GB/s\n", bytes / (total * 1e6));
+    } else {
+        printf("(too fast to measure)\n");
+    }
+} // print_results_bandwidth
+
+/*
+ * Displays the time for `count` n x n multiplies, and the throughput that implies,
+ * in matrices per second.
+ */
+void print_results_batched(const char *label, int n, long count, unsigned long total) {
+    printf("  n = %2d  %-12s TIME TO COMPLETION = %lu msec.  ", n, label, total);
+    if (total) {
+        printf("%.3g matrices/s\n", count * 1000.0 / total);
+    } else {
+        printf("(too fast to measure)\n");
+    }
+} // print_results_batched
+
+/*
+ * Prints a counter value with an SI suffix, in a fixed width, or "n/a" if the
+ * counter wasn't available (count < 0).
+ */
+static void print_count(const char *name, long long count) {
+    const char *suffix = " kMGT";
+    double v = (double)count;
+    int s = 0;
+
+    if (count < 0) {
+        printf("  %s %7s", name, "n/a");
+        return;
+    }
+    while (v >= 1000.0 && s < 4) {
+        v /= 1000.0;
+        s++;
+    }
+    printf("  %s %6.1f%c", name, v, suffix[s]);
+} // print_count
+
+/*
+ * Displays one instrumented run (see perf.h):  the time, to the microsecond, then
+ * the rates derived from it and from the counters.  `flops` is the floating-point
+ * work of the run (0 for none, as in a transpose).  `bytes` is the memory traffic
+ * to charge it with; 0 means to measure it instead, as LLC misses times a 64-byte
+ * line, when that counter is available.  GFLOP/s against GB/s shows which of the
+ * two a kernel is bound by; IPC and the miss counts show why.
+ */
+void print_results_perf(const char *label, PerfSample s, double flops, double bytes) {
+    long long cycles = s.count[PERF_CYCLES], instructions = s.count[PERF_INSTRUCTIONS];
+
+    if (bytes <= 0 && s.count[PERF_LLC_MISSES] >= 0) bytes = 64.0 * s.count[PERF_LLC_MISSES];
+
+    printf("  %-12s %10.3f ms", label, s.ns / 1e6);
+    if (flops > 0 && s.ns > 0) {
+        printf("  %7.2f GFLOP/s", flops / s.ns);
+    } else {
+        printf("  %7s GFLOP/s", "-");
+    }
+    if (bytes > 0 && s.ns > 0) {
+        printf("  %7.2f GB/s", bytes / s.ns);
+    } else {
+        printf("  %7s GB/s", "n/a");
+    }
+    if (cycles > 0 && instructions >= 0) {
+        printf("  IPC %5.2f", (double)instructions / cycles);
+    } else {
+        printf("  IPC %5s", "n/a");
+    }
+    print_count("L1d", s.count[PERF_L1D_MISSES]);
+    print_count("LLC", s.count[PERF_LLC_MISSES]);
+    print_count("dTLB", s.count[PERF_DTLB_MISSES]);
+    printf("\n");
+} // print_results_perf
+
 /*
  * Nicely-formatted presentation of A * B = C.  Obviously, we assume the
  * contents of A,B, and C are compatible with this display.  All three are
@@ -158,6 +511,24 @@ void print_matrix_product(int n, double *A, double *B, double *C) {
     }
 } // print_matrix_product
 
+/*
+ * Prints one line for the comparison d:  the label, the largest ulp and relative
+ * differences, and PASS or FAIL.  Returns whether it passed.
+ */
+bool print_matrix_diff(const char *label, MatrixDiff d) {
+    printf("  %-24s max ulps = %-6llu max rel = %-10.3g %s\n", label, (unsigned long long)d.max_ulp, d.max_rel,
+           (d.ok ? "PASS" : "FAIL"));
+    return d.ok;
+} // print_matrix_diff
+
+/*
+ * Compares C against the reference R (see matrix_compare) and prints the result
+ * as print_matrix_diff does.  Returns whether C passed.
+ */
+bool print_matrix_compare(const char *label, int n, double *R, double *C, double tol) {
+    return print_matrix_diff(label, matrix_compare(n, R, C, tol));
+} // print_matrix_compare
+
 /*
  * Nicely-formatted display of M, which is assumed to be an n x n matrix.
  *
@@ -216,6 +587,17 @@ long long timeInMilliseconds() {
     return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
 } // timeInMilliseconds
 
+/*
+ * Current time in nanoseconds, from CLOCK_MONOTONIC_RAW:  unaffected by NTP slewing,
+ * and fine-grained enough to time the small-n kernels that round to 0 msec.
+ */
+long long timeInNanoseconds() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ((long long)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+} // timeInNanoseconds
+
 /////////////////////////////////////////////////////////////////////////
 /* 
  * A constant, a global variable, and a simple utility method, which aid
@@ -268,34 +650,284 @@ void transpose_li(int n, double *M, double *M_t) {
     }
 } // transpose_li
 
+/*
+ * The body of transpose_bl for a single bs x bs tile whose upper-left corner is
+ * M[i0][j0].  Tiles on the bottom and right edges may be cut short by n, so the
+ * loop bounds are only constant when `bs` is, and the tile lies entirely inside M.
+ * When the CPU has vector registers, the tile goes to the vectorized kernels instead,
+ * which transpose it one register-sized square at a time:  Simd.tr_fixed[bs], built
+ * for that constant size, if the tile is whole and there is one, else Simd.tr_tile.
+ */
+static inline __attribute__((always_inline)) void transpose_bl_tile(int n, int bs, double *M, double *M_t,
+                                                                    int i0, int j0) {
+    bool full = (i0 + bs <= n && j0 + bs <= n);
+
+    if (full && bs <= FIXED_BLOCK_MAX && Simd.tr_fixed && Simd.tr_fixed[bs]) {
+        Simd.tr_fixed[bs](n, M, M_t, i0, j0);
+    } else if (Simd.tr_tile) {
+        Simd.tr_tile(n, M, M_t, i0, j0, (i0 + bs <= n ? bs : n - i0), (j0 + bs <= n ? bs : n - j0));
+    } else if (full) {
+        for (int i = i0; i < i0 + bs; i++) {
+            for (int j = j0; j < j0 + bs; j++) {
+                M_t[j * n + i] = M[i * n + j];
+            }
+        }
+    } else {
+        for (int i = i0; (i < i0 + bs) && (i < n); i++) {
+            for (int j = j0; (j < j0 + bs) && (j < n); j++) {
+                M_t[j * n + i] = M[i * n + j];
+            }
+        }
+    }
+} // transpose_bl_tile
+
+/*
+ * The outer (block) loops of transpose_bl.  Always inlined, so that each fixed-size
+ * wrapper below gets its own copy with `bs` folded into a constant.
+ */
+static inline __attribute__((always_inline)) void transpose_bl_kernel(int n, int bs, double *M, double *M_t) {
+    int N = (n % bs == 0 ? (n / bs) : (n / bs) + 1);
+    // # of block rows & block columns
+    // (gymnastics to handle the case where bs does not evenly divide n)
+
+    for (int ii = 0; ii < N; ii++) {     // for every row block
+        for (int jj = 0; jj < N; jj++) { // every column block
+
+            if (check_shortcircuit()) return;
+            transpose_bl_tile(n, bs, M, M_t, ii * bs, jj * bs);
+        }
+    }
+} // transpose_bl_kernel
+
+#define TRANSPOSE_BL_FIXED(BS)                                                        \
+    static void transpose_bl_##BS(int n, double *M, double *M_t) {                    \
+        transpose_bl_kernel(n, BS, M, M_t);                                           \
+    }                                                                                 \
+    static void transpose_bl_tile_##BS(int n, int bs, double *M, double *M_t, int i0, \
+                                       int j0) {                                      \
+        (void)bs;                                                                     \
+        transpose_bl_tile(n, BS, M, M_t, i0, j0);                                     \
+    }
+
+TRANSPOSE_BL_FIXED(8)
+TRANSPOSE_BL_FIXED(16)
+TRANSPOSE_BL_FIXED(32)
+TRANSPOSE_BL_FIXED(64)
+
+static void transpose_bl_tile_any(int n, int bs, double *M, double *M_t, int i0, int j0) {
+    transpose_bl_tile(n, bs, M, M_t, i0, j0);
+}
+
 /*
  * Calculates the transpose of M, which is stored in M_t.
- * This adds to the naive approach the ability to calculate the transpose in blocks,
- * as determined by the value of BLOCKSZ.
+ * This adds to the naive approach the ability to calculate the transpose in blocks
+ * of blocksz x blocksz.  A blocksz <= 0 selects this host's tuned size for n (see
+ * tune.h), or without a profile the compile-time default, BLOCKSZ.
+ *
+ * Compiler optimizations do a better job with a hard constant for the block size, so
+ * the common sizes (8, 16, 32, 64) dispatch to copies of the kernel specialized for
+ * that constant; anything else runs the generic kernel.
  *
  * NOTE:  Unlike the matrix multiplication function (dgemm_blocked), there isn't as much
  * benefit to blocking here, as there really is no way to eliminate the stride-n access
  * pattern in M or M_t.
  */
-void transpose_bl(int n, double *M, double *M_t) {
-    // Compiler optimizations do a better job with a hard constant for this value.  For now,
-    // I'm going to leave this here instead of putting the constant everywhere, in case
-    // someone wants to experiment with dynamically-set values for the block size.
-    int N = (n % BLOCKSZ == 0 ? (n / BLOCKSZ) : (n / BLOCKSZ) + 1);
-    // # of block rows & block columns
-    // (gymnastics to handle the case where BLOCKSZ does not evenly divide n)
+void transpose_bl(int n, int blocksz, double *M, double *M_t) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_TRANSPOSE_BL, n);
 
-    for (int ii = 0; ii < N; ii++) {     // for every row block
-        for (int jj = 0; jj < N; jj++) { // every column block
+    switch (blocksz) {
+    case 8:  transpose_bl_8(n, M, M_t); break;
+    case 16: transpose_bl_16(n, M, M_t); break;
+    case 32: transpose_bl_32(n, M, M_t); break;
+    case 64: transpose_bl_64(n, M, M_t); break;
+    default: transpose_bl_kernel(n, blocksz, M, M_t); break;
+    }
+} // transpose_blocked
 
-            if (check_shortcircuit()) return;
-            // (beginning of adapted transpose() body)
-            for (int i = ii * BLOCKSZ; (i < (ii + 1) * BLOCKSZ) && (i < n); i++) {
-                for (int j = jj * BLOCKSZ; (j < (jj + 1) * BLOCKSZ) && (j < n); j++) {
+/*
+ * Tile (ii, jj) of transpose_bl on its own, with the same specialized kernels, for
+ * schedulers outside this file (see jobs.c).  The short-circuit hook is not
+ * consulted.
+ */
+void transpose_bl_tile_at(int n, int blocksz, double *M, double *M_t, int ii, int jj) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_TRANSPOSE_BL, n);
+
+    switch (blocksz) {
+    case 8:  transpose_bl_tile_8(n, 8, M, M_t, ii * 8, jj * 8); break;
+    case 16: transpose_bl_tile_16(n, 16, M, M_t, ii * 16, jj * 16); break;
+    case 32: transpose_bl_tile_32(n, 32, M, M_t, ii * 32, jj * 32); break;
+    case 64: transpose_bl_tile_64(n, 64, M, M_t, ii * 64, jj * 64); break;
+    default: transpose_bl_tile_any(n, blocksz, M, M_t, ii * blocksz, jj * blocksz); break;
+    }
+} // transpose_bl_tile_at
+
+typedef struct tr_job_t {
+    int n, bs, n_blocks;
+    double *M, *M_t;
+    void (*fn)(int n, int bs, double *M, double *M_t, int i0, int j0);
+} TrJob;
+
+static void transpose_bl_job_tile(void *ctx, int tile) {
+    TrJob *job = ctx;
+    int ii = tile / job->n_blocks, jj = tile % job->n_blocks;
+    job->fn(job->n, job->bs, job->M, job->M_t, ii * job->bs, jj * job->bs);
+}
+
+/*
+ * transpose_bl on `nthreads` threads (<= 0 means one per online CPU), with the
+ * tiles scheduled by work stealing (see run_tiles_ws).  Every tile of M_t is
+ * written by exactly one thread.  The short-circuit hook is not consulted.
+ */
+void transpose_bl_ws(int n, int blocksz, int nthreads, double *M, double *M_t) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_TRANSPOSE_BL, n);
+
+    int n_blocks = (n + blocksz - 1) / blocksz;
+    TrJob job = {.n = n, .bs = blocksz, .n_blocks = n_blocks, .M = M, .M_t = M_t};
+
+    switch (blocksz) {
+    case 8:  job.fn = transpose_bl_tile_8; break;
+    case 16: job.fn = transpose_bl_tile_16; break;
+    case 32: job.fn = transpose_bl_tile_32; break;
+    case 64: job.fn = transpose_bl_tile_64; break;
+    default: job.fn = transpose_bl_tile_any; break;
+    }
+    run_tiles_ws(nthreads, n_blocks * n_blocks, transpose_bl_job_tile, &job);
+} // transpose_bl_ws
+
+// Recursion stops at tiles of at most this many rows and columns.  It is a
+// multiple of every vector width, so the splits never cut a SIMD square in two.
+#define REC_TR_BASE 32
+
+/*
+ * The rows x cols tile of M at M[i0][j0], transposed into M_t by recursively halving
+ * its longer side.
+ */
+static void transpose_rec_tile(int n, double *M, double *M_t, int i0, int j0, int rows, int cols) {
+    if (rows <= REC_TR_BASE && cols <= REC_TR_BASE) {
+        if (Simd.tr_tile) {
+            Simd.tr_tile(n, M, M_t, i0, j0, rows, cols);
+        } else {
+            for (int i = i0; i < i0 + rows; i++) {
+                for (int j = j0; j < j0 + cols; j++) {
                     M_t[j * n + i] = M[i * n + j];
                 }
             }
-            // (end of adapted transpose() body)
         }
+    } else if (rows >= cols) {
+        int half = rows / 2 / REC_TR_BASE * REC_TR_BASE;
+        if (half == 0) half = REC_TR_BASE;
+        transpose_rec_tile(n, M, M_t, i0, j0, half, cols);
+        transpose_rec_tile(n, M, M_t, i0 + half, j0, rows - half, cols);
+    } else {
+        int half = cols / 2 / REC_TR_BASE * REC_TR_BASE;
+        if (half == 0) half = REC_TR_BASE;
+        transpose_rec_tile(n, M, M_t, i0, j0, rows, half);
+        transpose_rec_tile(n, M, M_t, i0, j0 + half, rows, cols - half);
     }
-} // transpose_blocked
+} // transpose_rec_tile
+
+/*
+ * A cache-oblivious transpose:  M is split in half along its longer side, over and
+ * over, until the pieces are at most REC_TR_BASE x REC_TR_BASE, and each piece is
+ * transposed with the in-register Simd.tr_tile kernel.  At every level of the
+ * recursion, some piece (and its image in M_t) fits in each level of cache, so this
+ * gets the locality of blocking without a block size to tune.
+ */
+void transpose_rec(int n, double *M, double *M_t) {
+    transpose_rec_tile(n, M, M_t, 0, 0, n, n);
+} // transpose_rec
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * In-place transposition.  M is cut into INPLACE_BLOCK x INPLACE_BLOCK tiles;
+ * each tile above the diagonal is swapped (transposed) with its mirror image
+ * below it, and each tile on the diagonal is transposed within itself.
+ */
+#define INPLACE_BLOCK 32
+
+/*
+ * Transposes the len x len tile on the diagonal at M[i0][i0] within itself, by
+ * swapping each element above the tile's diagonal with its mirror image.
+ */
+static void transpose_inplace_diag(int n, double *M, int i0, int len) {
+    for (int i = i0; i < i0 + len; i++) {
+        for (int j = i + 1; j < i0 + len; j++) {
+            double t = M[i * n + j];
+            M[i * n + j] = M[j * n + i];
+            M[j * n + i] = t;
+        }
+    }
+} // transpose_inplace_diag
+
+/*
+ * Swaps the ilen x jlen tile at M[i0][j0] (above the diagonal) with the transpose
+ * of its mirror image at M[j0][i0].
+ */
+static void transpose_inplace_pair(int n, double *M, int i0, int j0, int ilen, int jlen) {
+    if (Simd.tr_swap) {
+        Simd.tr_swap(n, M, i0, j0, ilen, jlen);
+        return;
+    }
+    for (int i = i0; i < i0 + ilen; i++) {
+        for (int j = j0; j < j0 + jlen; j++) {
+            double t = M[i * n + j];
+            M[i * n + j] = M[j * n + i];
+            M[j * n + i] = t;
+        }
+    }
+} // transpose_inplace_pair
+
+/*
+ * Handles tile (ii, jj):  a diagonal tile, the pair (ii, jj)/(jj, ii) if ii < jj,
+ * or nothing if ii > jj (that tile belongs to the pair above the diagonal).
+ */
+static void transpose_inplace_tile(int n, double *M, int ii, int jj) {
+    int i0 = ii * INPLACE_BLOCK, j0 = jj * INPLACE_BLOCK;
+    int ilen = (i0 + INPLACE_BLOCK < n ? INPLACE_BLOCK : n - i0);
+    int jlen = (j0 + INPLACE_BLOCK < n ? INPLACE_BLOCK : n - j0);
+
+    if (ii == jj) {
+        transpose_inplace_diag(n, M, i0, ilen);
+    } else if (ii < jj) {
+        transpose_inplace_pair(n, M, i0, j0, ilen, jlen);
+    }
+} // transpose_inplace_tile
+
+/*
+ * Transposes the n x n matrix M in place, without a second n x n buffer.
+ * For example, [1,2,3,4,5,6,7,8,9]  ===>  [1,4,7,2,5,8,3,6,9].  Off-diagonal tile
+ * pairs are exchanged with the in-register Simd.tr_swap kernel when there is one.
+ */
+void transpose_inplace(int n, double *M) {
+    int N = (n + INPLACE_BLOCK - 1) / INPLACE_BLOCK;
+
+    for (int ii = 0; ii < N; ii++) {
+        for (int jj = ii; jj < N; jj++) {
+            transpose_inplace_tile(n, M, ii, jj);
+        }
+    }
+} // transpose_inplace
+
+typedef struct inplace_job_t {
+    int n, n_blocks;
+    double *M;
+} InplaceJob;
+
+static void transpose_inplace_job_tile(void *ctx, int tile) {
+    InplaceJob *job = ctx;
+    transpose_inplace_tile(job->n, job->M, tile / job->n_blocks, tile % job->n_blocks);
+}
+
+/*
+ * transpose_inplace on `nthreads` threads (<= 0 means one per online CPU).  Each
+ * diagonal tile, and each pair of mirror-image tiles, is handled by exactly one
+ * thread, so no element is touched twice.  The tiles below the diagonal are no-op
+ * tasks; the work-stealing scheduler (run_tiles_ws) evens out the imbalance that
+ * leaves.
+ */
+void transpose_inplace_mt(int n, int nthreads, double *M) {
+    int N = (n + INPLACE_BLOCK - 1) / INPLACE_BLOCK;
+    InplaceJob job = {.n = n, .n_blocks = N, .M = M};
+
+    run_tiles_ws(nthreads, N * N, transpose_inplace_job_tile, &job);
+} // transpose_inplace_mt
@@ -1,4 +1,9 @@
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "perf.h"
+#include "typed.h"
 
 #ifndef BLOCKSZ
 #define BLOCKSZ 1
@@ -11,30 +16,83 @@
 #ifndef BLOCKING_H
 #define BLOCKING_H
 
+// make_one_matrix, fill and zero work in ranges of this many elements (2 MB, cut on
+// the same HUGE_PAGE boundaries as matrix_first_touch's), one thread per range up
+// to one per CPU
+#define FILL_CHUNK (1L << 18)
+
+// ...and with non-temporal stores from this many bytes up:  a buffer well past the
+// last-level cache would only evict everything else on its way through
+#define FILL_STREAM_BYTES (32L << 20)
+
 typedef struct mmt_t {
     unsigned long total_basic; // naive matrix multiplication runtime
     unsigned long total_cm;    // runtime for multiplicand realignment
     unsigned long total_li;    // runtime for loop interchange
     unsigned long total_bl;    // runtime for blocking
+    unsigned long total_tiled; // runtime for multi-level tiling
+    unsigned long total_pk;    // runtime for multi-level tiling with packed panels
+    unsigned long total_rec;   // runtime for cache-oblivious recursion
+    unsigned long total_sw;    // runtime for Strassen-Winograd
+    unsigned long total_gemm;  // runtime for gemm (beta = 0, so without zeroing C)
 } MMTotals;
 
+typedef struct args_t {
+    int n;         // matrix row/column dimension
+    int blocksz;   // block size for the blocked kernels (-b), 0 = tuned (see tune.h)
+    int threads;   // thread count for the parallel kernels (-t), 0 = one per CPU
+    ElemType type; // element type for the typed kernels (-T), default double
+    bool numa;     // NUMA placement for the parallel kernels (-N), default off
+    int warmup;    // untimed runs before the timed ones (-w), default 0
+    int reps;      // timed runs per variant (-r), default 1
+    BenchFormat format; // structured output (-o csv|json), default the console tables
+    const char *kernel; // the one variant to run (-k), default NULL for all of them
+} Args;
+
+/*
+ * How far apart two matrices are (see matrix_compare).  A NaN or infinity that
+ * the other matrix doesn't match exactly counts as infinitely far.
+ */
+typedef struct matrix_diff_t {
+    double max_abs;   // largest |X - Y|
+    double max_rel;   // largest |X - Y| / max(|X|, |Y|)
+    uint64_t max_ulp; // largest distance in units in the last place
+    bool ok;          // max_rel <= the tolerance asked for
+} MatrixDiff;
+
 void printUsage(char *);
-int get_arg(int, char **);
+Args get_args(int, char **);
+int ragged_block(Args, int);
 double *make_one_matrix(int);
+void fill(int, double *M, double);
 void zero(int, double *M);
+double max_abs_diff(int, double *, double *);
+MatrixDiff matrix_compare(int, double *X, double *Y, double tol);
 
 void print_results_transpose(int, int, unsigned long, unsigned long);
 void print_results_matmult(int, MMTotals);
+void print_results_threads(int, unsigned long, unsigned long, bool);
+void print_results_bandwidth(const char *, int, size_t, unsigned long);
+void print_results_batched(const char *, int, long, unsigned long);
+void print_results_perf(const char *, PerfSample, double, double);
 void print_matrix_product(int, double *, double *, double *);
+bool print_matrix_diff(const char *, MatrixDiff);
+bool print_matrix_compare(const char *, int, double *R, double *C, double tol);
 
 void print_one_matrix(int, double *, bool);
 void print_matrix_linear(int, double *);
 
 long long timeInMilliseconds(void);
+long long timeInNanoseconds(void);
 
 bool check_shortcircuit(void);
 void transpose(int n, double *M, double *M_t);
 void transpose_li(int n, double *M, double *M_t);
-void transpose_bl(int n, double *M, double *M_t);
+void transpose_bl(int n, int blocksz, double *M, double *M_t);
+void transpose_bl_ws(int n, int blocksz, int nthreads, double *M, double *M_t);
+void transpose_bl_tile_at(int n, int blocksz, double *M, double *M_t, int ii, int jj);
+void transpose_rec(int n, double *M, double *M_t);
+void transpose_inplace(int n, double *M);
+void transpose_inplace_mt(int n, int nthreads, double *M);
 
 #endif
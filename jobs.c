@@ -0,0 +1,486 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "jobs.h"
+#include "placement.h"
+#include "simd.h"
+#include "tasks.h"
+#include "threads.h"
+#include "tune.h"
+
+struct mm_request_t {
+    MmJob job;
+    int bs, nb;           // the block size in use, and tiles per side
+    bool small;           // runs whole, from the small lane
+    int chunk, chunks;    // a large job's tiles per chunk, and how many chunks
+    long work;            // multiply-adds (or element moves) per chunk, or for the whole of a small job
+    _Atomic int next;     // a large job's next chunk to claim
+    _Atomic int pending;  // unfinished chunks, plus one while the large lane holds it
+    int claimers;         // workers claiming its chunks; guarded by Large.lock
+    bool unlinked;        // out of the large lane; guarded by Large.lock
+    MmHandle link;        // the next large job in line; guarded by Large.lock
+    _Atomic bool done;
+    pthread_mutex_t lock; // guards the wait on cv, not the fields above
+    pthread_cond_t cv;
+};
+
+// The handle for jobs that mm_submit finished itself:  always done, never freed
+static struct mm_request_t Finished = {.done = true};
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * The small lane:  a bounded, lock-free, multi-producer multi-consumer ring
+ * (Vyukov's) of the jobs that run whole.  Each cell carries a sequence number that says whose turn it is:
+ * pos when it is free for the producer that claims position pos, pos + 1 once
+ * that producer has filled it, and pos + JOBQ_SIZE once the consumer of pos has
+ * emptied it for the next lap.  Producers and consumers claim positions with a
+ * compare-and-swap on their own counter, so they never contend with each other.
+ */
+typedef struct jobq_cell_t {
+    _Atomic size_t seq;
+    MmHandle req;
+} JobqCell;
+
+static JobqCell Queue[JOBQ_SIZE];
+static _Alignas(64) _Atomic size_t Enq_Pos;
+static _Alignas(64) _Atomic size_t Deq_Pos;
+static _Alignas(64) _Atomic long Queued; // small jobs and large ones with chunks left (may dip below 0 briefly)
+
+static void jobq_init(void) {
+    for (size_t i = 0; i < JOBQ_SIZE; i++) {
+        atomic_init(&Queue[i].seq, i);
+    }
+    atomic_store(&Enq_Pos, 0);
+    atomic_store(&Deq_Pos, 0);
+    atomic_store(&Queued, 0);
+} // jobq_init
+
+/*
+ * Appends r to the small lane.  Returns false if it is full.
+ */
+static bool jobq_push(MmHandle r) {
+    size_t pos = atomic_load_explicit(&Enq_Pos, memory_order_relaxed);
+
+    for (;;) {
+        JobqCell *cell = &Queue[pos & (JOBQ_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&Enq_Pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->req = r;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                atomic_fetch_add(&Queued, 1);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&Enq_Pos, memory_order_relaxed);
+        }
+    }
+} // jobq_push
+
+/*
+ * Takes the job at the head of the small lane into *r.  Returns false if it is
+ * empty.
+ */
+static bool jobq_pop(MmHandle *r) {
+    size_t pos = atomic_load_explicit(&Deq_Pos, memory_order_relaxed);
+
+    for (;;) {
+        JobqCell *cell = &Queue[pos & (JOBQ_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&Deq_Pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *r = cell->req;
+                atomic_store_explicit(&cell->seq, pos + JOBQ_SIZE, memory_order_release);
+                atomic_fetch_sub(&Queued, 1);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&Deq_Pos, memory_order_relaxed);
+        }
+    }
+} // jobq_pop
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * The large lane:  the large jobs with chunks still to hand out, in order of
+ * submission, one entry per job however many chunks it has.  Workers claim the
+ * chunks of the first with an atomic increment of its cursor, so the lock is only
+ * taken to join a job and to leave it, not per chunk.
+ */
+static struct {
+    pthread_mutex_t lock;
+    MmHandle head, tail;
+} Large = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * The worker pool.  Workers only take the lock to go to sleep, when both lanes
+ * are empty, and submitters only to wake them, when some are asleep.
+ */
+static struct {
+    pthread_mutex_t start; // serializes mm_pool_start and mm_pool_stop
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    _Atomic int sleepers;
+    _Atomic bool stop;
+    _Atomic int nthreads; // 0 while the pool isn't running
+    pthread_t *tids;
+} Pool = {
+    .start = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Drops one of r's pending counts, and wakes r's waiter after the last.
+ */
+static void finish(MmHandle r) {
+    if (atomic_fetch_sub(&r->pending, 1) == 1) {
+        pthread_mutex_lock(&r->lock);
+        atomic_store(&r->done, true);
+        pthread_cond_broadcast(&r->cv);
+        pthread_mutex_unlock(&r->lock);
+    }
+} // finish
+
+/*
+ * Runs tiles [first, last) of r's job, of matmult_bl or transpose_bl.  A multiply
+ * tile of C is zeroed before it accumulates, which is what lets C start out
+ * holding anything.
+ */
+static void run_tiles(MmHandle r, int first, int last) {
+    MmJob *job = &r->job;
+    int n = job->n, bs = r->bs;
+
+    for (int t = first; t < last; t++) {
+        int ii = t / r->nb, jj = t % r->nb;
+
+        if (job->op == MM_TRANSPOSE) {
+            transpose_bl_tile_at(n, bs, job->A, job->C, ii, jj);
+            continue;
+        }
+
+        int i0 = ii * bs, rows = (i0 + bs < n) ? bs : n - i0;
+        int j0 = jj * bs, cols = (j0 + bs < n) ? bs : n - j0;
+        for (int i = i0; i < i0 + rows; i++) {
+            memset(job->C + (long)i * n + j0, 0, cols * sizeof(double));
+        }
+        matmult_bl_ctile_at(n, bs, job->A, job->B, job->C, ii, jj);
+    }
+} // run_tiles
+
+/*
+ * Runs r's job whole:  a multiply of n <= BATCH_MAX with the fully unrolled kernel
+ * of matmult_batched, anything else tile by tile.
+ */
+static void run_whole(MmHandle r) {
+    MmJob *job = &r->job;
+
+    if (job->op == MM_MATMULT && job->n <= BATCH_MAX) {
+        Simd.batch[job->n](job->A, job->B, job->C);
+    } else {
+        run_tiles(r, 0, r->nb * r->nb);
+    }
+} // run_whole
+
+/*
+ * Runs a small job whole, then marks it done.
+ */
+static void run_small(MmHandle r) {
+    run_whole(r);
+    finish(r);
+} // run_small
+
+/*
+ * Claims a batch of small jobs into reqs[]:  up to JOB_BATCH of them, while their
+ * work adds up to less than JOB_ITEM_WORK, so that a burst of tiny ones is taken a
+ * handful per trip to the lane.  Returns how many were claimed.
+ */
+static int claim_small(MmHandle reqs[JOB_BATCH]) {
+    long work = 0;
+    int count = 0;
+
+    while (count < JOB_BATCH && work < JOB_ITEM_WORK && jobq_pop(&reqs[count])) {
+        work += reqs[count]->work;
+        count++;
+    }
+    return count;
+} // claim_small
+
+/*
+ * Works on the first large job in line, if there is one:  claims its chunks one at
+ * a time and runs them until there are none left (or, if `until` isn't NULL,
+ * until that job is done), running any small jobs that arrive first, before each
+ * chunk.  So a small job waits behind at most the chunk each worker has in hand,
+ * however large the jobs ahead of it.  Returns false if the large lane was empty.
+ */
+static bool run_large(MmHandle until) {
+    MmHandle r, small;
+
+    pthread_mutex_lock(&Large.lock);
+    r = Large.head;
+    if (r) r->claimers++;
+    pthread_mutex_unlock(&Large.lock);
+    if (!r) return false;
+
+    bool exhausted = false;
+    while (!(until && atomic_load(&until->done))) {
+        while (jobq_pop(&small)) {
+            run_small(small);
+        }
+        int c = atomic_fetch_add(&r->next, 1);
+        if (c >= r->chunks) {
+            exhausted = true;
+            break;
+        }
+
+        int first = c * r->chunk;
+        run_tiles(r, first, (first + r->chunk < r->nb * r->nb) ? first + r->chunk : r->nb * r->nb);
+        finish(r);
+    }
+
+    // Once every chunk is handed out, the first to see it takes r out of line, and
+    // the last to leave after that drops the lane's hold on it (after which r may
+    // be freed)
+    pthread_mutex_lock(&Large.lock);
+    if (exhausted && !r->unlinked) {
+        Large.head = r->link;
+        if (!Large.head) Large.tail = NULL;
+        r->unlinked = true;
+        atomic_fetch_sub(&Queued, 1);
+    }
+    bool last = --r->claimers == 0 && r->unlinked;
+    pthread_mutex_unlock(&Large.lock);
+    if (last) finish(r);
+    return true;
+} // run_large
+
+/*
+ * One round of work from either lane, small jobs first, for a worker (`until`
+ * NULL) or for the waiter of `until`.  A small job's waiter only helps with other
+ * small jobs, since a chunk of a large one could take longer than its own.
+ * Returns false if there was nothing to do.
+ */
+static bool run_some(MmHandle until) {
+    MmHandle reqs[JOB_BATCH];
+    int count = claim_small(reqs);
+
+    for (int i = 0; i < count; i++) {
+        run_small(reqs[i]);
+    }
+    return count || ((!until || !until->small) && run_large(until));
+} // run_some
+
+static void *job_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+
+    numa_pin(id, atomic_load(&Pool.nthreads), NULL);
+    for (;;) {
+        if (run_some(NULL)) continue;
+
+        // Both lanes are empty:  sleep until a submitter adds more, or the pool
+        // stops.  Bumping `sleepers` before the last look at `Queued` (which
+        // mm_submit bumps before it looks at `sleepers`) means no wakeup is lost.
+        pthread_mutex_lock(&Pool.lock);
+        atomic_fetch_add(&Pool.sleepers, 1);
+        while (!atomic_load(&Pool.stop) && atomic_load(&Queued) <= 0) {
+            pthread_cond_wait(&Pool.wake, &Pool.lock);
+        }
+        atomic_fetch_sub(&Pool.sleepers, 1);
+        bool stop = atomic_load(&Pool.stop) && atomic_load(&Queued) <= 0;
+        pthread_mutex_unlock(&Pool.lock);
+        if (stop) return NULL;
+    }
+} // job_worker
+
+/*
+ * Starts the pool with `nthreads` workers (see num_threads), if it isn't running
+ * already.  mm_submit starts it with one worker per CPU when it has to, so this
+ * is only needed to choose another size.  Under Numa_Placement the workers are
+ * pinned, as in run_tiles_static.
+ */
+void mm_pool_start(int nthreads) {
+    pthread_mutex_lock(&Pool.start);
+    if (!atomic_load(&Pool.nthreads)) {
+        nthreads = num_threads(nthreads);
+        jobq_init();
+        atomic_store(&Pool.stop, false);
+        Pool.tids = malloc(nthreads * sizeof(pthread_t));
+        atomic_store(&Pool.nthreads, nthreads);
+        for (int i = 0; i < nthreads; i++) {
+            pthread_create(&Pool.tids[i], NULL, job_worker, (void *)(intptr_t)i);
+        }
+    }
+    pthread_mutex_unlock(&Pool.start);
+} // mm_pool_start
+
+/*
+ * Stops the pool, once the workers have drained the queue.  Every job submitted
+ * still has to be waited for; no new ones may be submitted until it returns.
+ */
+void mm_pool_stop(void) {
+    pthread_mutex_lock(&Pool.start);
+    int nthreads = atomic_load(&Pool.nthreads);
+
+    if (nthreads) {
+        pthread_mutex_lock(&Pool.lock);
+        atomic_store(&Pool.stop, true);
+        pthread_cond_broadcast(&Pool.wake);
+        pthread_mutex_unlock(&Pool.lock);
+        for (int i = 0; i < nthreads; i++) {
+            pthread_join(Pool.tids[i], NULL);
+        }
+        free(Pool.tids);
+        Pool.tids = NULL;
+        atomic_store(&Pool.nthreads, 0);
+    }
+    pthread_mutex_unlock(&Pool.start);
+} // mm_pool_stop
+
+/*
+ * The number of workers in the pool, or 0 if it isn't running.
+ */
+int mm_pool_threads(void) {
+    return atomic_load(&Pool.nthreads);
+} // mm_pool_threads
+
+/*
+ * Fills in r's job, and how it is to be split, for `job` (n > 0).  Returns whether
+ * it is small.
+ */
+static bool size_request(MmHandle r, MmJob job) {
+    int n = job.n;
+    int bs = job.blocksz > 0 ? job.blocksz : tune_block(job.op == MM_MATMULT ? TUNE_MATMULT_BL : TUNE_TRANSPOSE_BL, n);
+    int nb = (n + bs - 1) / bs, tiles = nb * nb;
+    long tile_work = (job.op == MM_MATMULT) ? (long)bs * bs * n : (long)bs * bs;
+    long total = (job.op == MM_MATMULT) ? (long)n * n * n : (long)n * n;
+    bool small = total <= JOB_ITEM_WORK || (job.op == MM_MATMULT && n <= BATCH_MAX);
+
+    r->job = job;
+    r->small = small;
+    r->bs = bs;
+    r->nb = nb;
+    r->chunk = (tile_work < JOB_ITEM_WORK) ? (int)(JOB_ITEM_WORK / tile_work) : 1;
+    if (r->chunk > tiles) r->chunk = tiles;
+    r->chunks = (tiles + r->chunk - 1) / r->chunk;
+    r->work = small ? total : tile_work * r->chunk;
+    return small;
+} // size_request
+
+/*
+ * Queues `job` and returns a handle to it at once; pass the handle to mm_wait
+ * (exactly once) to wait for the result and release it.  A job with no more than
+ * JOB_ITEM_WORK of work (which includes every multiply of n <= BATCH_MAX) goes in
+ * the small lane and runs whole.  Anything larger goes in the large lane as one
+ * entry, whose bs x bs tiles (bs the block size in use) are handed out in chunks
+ * of about JOB_ITEM_WORK apiece to any worker that asks, so one large job uses
+ * the whole pool.  Workers take small jobs ahead of the next chunk, so they never
+ * queue behind a large one.  Only if the small lane is full does the submitter
+ * run small jobs itself until there is room.
+ *
+ * A job with n <= 0 has nothing to do, and one that there is no memory to queue
+ * runs on the calling thread;  either way, the handle returned is already done.
+ */
+MmHandle mm_submit(MmJob job) {
+    if (job.n <= 0) return &Finished;
+    if (!atomic_load(&Pool.nthreads)) mm_pool_start(0);
+
+    MmHandle r = malloc(sizeof(*r));
+    if (!r) {
+        struct mm_request_t local;
+
+        size_request(&local, job);
+        run_whole(&local);
+        return &Finished;
+    }
+    bool small = size_request(r, job);
+
+    r->claimers = 0;
+    r->unlinked = false;
+    r->link = NULL;
+    atomic_init(&r->next, 0);
+    atomic_init(&r->pending, small ? 1 : r->chunks + 1);
+    atomic_init(&r->done, false);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cv, NULL);
+
+    if (small) {
+        MmHandle other;
+
+        while (!jobq_push(r)) {
+            if (jobq_pop(&other)) {
+                run_small(other);
+            } else {
+                sched_yield();
+            }
+        }
+    } else {
+        pthread_mutex_lock(&Large.lock);
+        if (Large.tail) {
+            Large.tail->link = r;
+        } else {
+            Large.head = r;
+        }
+        Large.tail = r;
+        atomic_fetch_add(&Queued, 1);
+        pthread_mutex_unlock(&Large.lock);
+    }
+
+    if (atomic_load(&Pool.sleepers) > 0) {
+        pthread_mutex_lock(&Pool.lock);
+        if (small) {
+            pthread_cond_signal(&Pool.wake);
+        } else {
+            pthread_cond_broadcast(&Pool.wake);
+        }
+        pthread_mutex_unlock(&Pool.lock);
+    }
+    return r;
+} // mm_submit
+
+/*
+ * Whether r's job is done (so mm_wait would return at once).
+ */
+bool mm_test(MmHandle r) {
+    return atomic_load(&r->done);
+} // mm_test
+
+/*
+ * Waits for r's job to finish, then releases r.  While either lane has work, from
+ * any job, the caller does it rather than sleep; that keeps the pool's throughput
+ * up under load, and bounds the wait by the last chunk of r's job already being
+ * run elsewhere.
+ */
+void mm_wait(MmHandle r) {
+    if (r == &Finished) return;
+
+    while (!atomic_load(&r->done)) {
+        if (!run_some(r)) break;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    while (!atomic_load(&r->done)) {
+        pthread_cond_wait(&r->cv, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cv);
+    free(r);
+} // mm_wait
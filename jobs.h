@@ -0,0 +1,55 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+// Slots in the small-job lane (a power of two).  When it is full, a submitter runs
+// small jobs itself until there is room.  Large jobs take one entry each in a
+// lane of their own, which has no bound.
+#define JOBQ_SIZE 1024
+
+// Large jobs are handed out in chunks of about this many multiply-adds (element
+// moves, for a transpose); a job with no more work than this is small, and runs
+// whole.
+#define JOB_ITEM_WORK (1L << 21)
+
+// A worker claims up to this many small jobs at once, while their work adds up to
+// less than JOB_ITEM_WORK
+#define JOB_BATCH 32
+
+/*
+ * The asynchronous job API.  A persistent pool of worker threads serves a stream
+ * of jobs submitted from any number of threads:  mm_submit queues a job and
+ * returns at once, and mm_wait blocks until it is done.  Large jobs are split
+ * into tiles of matmult_bl (or transpose_bl), which every worker shares, and
+ * small ones run whole, a batch of them per claim, ahead of the next chunk of any
+ * large one.
+ */
+typedef enum mm_op_t {
+    MM_MATMULT,   // C = A * B
+    MM_TRANSPOSE, // C = A' (B is unused)
+} MmOp;
+
+/*
+ * One job.  All matrices are n x n and row-major.  Unlike the matmult_* kernels,
+ * C is overwritten, so needn't be zeroed first; it must not overlap A or B, and
+ * none of them may be touched until the job is waited for.
+ */
+typedef struct mm_job_t {
+    MmOp op;
+    int n;
+    int blocksz; // as for matmult_bl and transpose_bl:  <= 0 selects the tuned size
+    double *A, *B, *C;
+} MmJob;
+
+typedef struct mm_request_t *MmHandle;
+
+void mm_pool_start(int nthreads);
+void mm_pool_stop(void);
+int mm_pool_threads(void);
+
+MmHandle mm_submit(MmJob job);
+bool mm_test(MmHandle);
+void mm_wait(MmHandle);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "layout.h"
+#include "simd.h"
+
+/*
+ * The number of doubles in the tile-major form of an n x n matrix, padding
+ * included.
+ */
+size_t tiled_count(int n, int bs) {
+    if (bs <= 0) bs = LAYOUT_TILE;
+
+    size_t nt = (n + bs - 1) / bs;
+    return nt * nt * bs * bs;
+} // tiled_count
+
+/*
+ * A zeroed n x n matrix in tiles of side bs, from matrix_alloc (release it with
+ * matrix_free).
+ */
+double *make_tiled_matrix(int n, int bs) {
+    size_t bytes = tiled_count(n, bs) * sizeof(double);
+    double *T = matrix_alloc(bytes);
+
+    matrix_first_touch(T, bytes, 0);
+    return T;
+} // make_tiled_matrix
+
+/*
+ * Copies the row-major n x n matrix M into T, in tiles of side bs (<= 0 selects
+ * LAYOUT_TILE, here and below).  T is written front to back, padding included.
+ */
+void to_tiled(int n, int bs, double *M, double *T) {
+    if (bs <= 0) bs = LAYOUT_TILE;
+
+    int nt = (n + bs - 1) / bs;
+
+    for (int ti = 0; ti < nt; ti++) {
+        for (int tj = 0; tj < nt; tj++) {
+            int j0 = tj * bs, cols = (n - j0 < bs) ? n - j0 : bs;
+
+            for (int r = 0; r < bs; r++, T += bs) {
+                int i = ti * bs + r;
+
+                if (i < n) {
+                    memcpy(T, M + (size_t)i * n + j0, cols * sizeof(double));
+                    memset(T + cols, 0, (bs - cols) * sizeof(double));
+                } else {
+                    memset(T, 0, bs * sizeof(double));
+                }
+            }
+        }
+    }
+} // to_tiled
+
+/*
+ * The inverse of to_tiled:  copies the tile-major T back into the row-major n x n
+ * matrix M, dropping the padding.
+ */
+void from_tiled(int n, int bs, double *T, double *M) {
+    if (bs <= 0) bs = LAYOUT_TILE;
+
+    int nt = (n + bs - 1) / bs;
+
+    for (int ti = 0; ti < nt; ti++) {
+        for (int tj = 0; tj < nt; tj++) {
+            int j0 = tj * bs, cols = (n - j0 < bs) ? n - j0 : bs;
+            int rows = (n - ti * bs < bs) ? n - ti * bs : bs;
+
+            for (int r = 0; r < rows; r++) {
+                memcpy(M + (size_t)(ti * bs + r) * n + j0, T + r * bs, cols * sizeof(double));
+            }
+            T += bs * bs;
+        }
+    }
+} // from_tiled
+
+/*
+ * C += A * B for one bs x bs tile of each.  The scalar fallback of matmult_tl,
+ * always inlined so the fixed-size copies below get constant loop bounds.
+ */
+static inline __attribute__((always_inline)) void matmult_tl_tile(int bs, double *A, double *B, double *C) {
+    for (int i = 0; i < bs; i++) {
+        for (int j = 0; j < bs; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < bs; k++) {
+                sum += A[i * bs + k] * B[k * bs + j];
+            }
+            C[i * bs + j] += sum;
+        }
+    }
+}
+
+/*
+ * The tile loops of matmult_tl.  Every tile is a full bs x bs block (the edges are
+ * padded), so unlike matmult_bl there are no ragged tiles to special-case:  each
+ * product reads two contiguous bs * bs runs and updates a third.
+ */
+static inline __attribute__((always_inline)) void matmult_tl_kernel(int n, int bs, double *A, double *B,
+                                                                    double *C) {
+    int nt = (n + bs - 1) / bs;
+
+    for (int ti = 0; ti < nt; ti++) {
+        for (int tj = 0; tj < nt; tj++) {
+            double *Ct = tiled_tile(n, bs, C, ti, tj);
+
+            for (int tk = 0; tk < nt; tk++) {
+                double *At = tiled_tile(n, bs, A, ti, tk);
+                double *Bt = tiled_tile(n, bs, B, tk, tj);
+
+                if (Simd.bl_tile) {
+                    Simd.bl_tile(bs, At, Bt, Ct, 0, 0, 0, bs, bs, bs);
+                } else {
+                    matmult_tl_tile(bs, At, Bt, Ct);
+                }
+            }
+        }
+    }
+}
+
+#define MATMULT_TL_FIXED(BS)                                                           \
+    static void matmult_tl_##BS(int n, double *A, double *B, double *C) {              \
+        matmult_tl_kernel(n, BS, A, B, C);                                             \
+    }
+
+MATMULT_TL_FIXED(8)
+MATMULT_TL_FIXED(16)
+MATMULT_TL_FIXED(32)
+MATMULT_TL_FIXED(64)
+
+/*
+ * matmult_bl on tile-major storage:  C += A * B, with all three n x n matrices in
+ * tiles of side bs (<= 0 selects LAYOUT_TILE).  As in matmult_bl, block sizes 8,
+ * 16, 32 and 64 run copies of the kernel specialized for that constant.
+ *
+ * PRECONDITIONS:  A, B, and C are tile-major with the same n and bs, and C is
+ * initialized to zero (padding included, as make_tiled_matrix and to_tiled leave it).
+ */
+void matmult_tl(int n, int bs, double *A, double *B, double *C) {
+    if (bs <= 0) bs = LAYOUT_TILE;
+
+    switch (bs) {
+    case 8:  matmult_tl_8(n, A, B, C); break;
+    case 16: matmult_tl_16(n, A, B, C); break;
+    case 32: matmult_tl_32(n, A, B, C); break;
+    case 64: matmult_tl_64(n, A, B, C); break;
+    default: matmult_tl_kernel(n, bs, A, B, C); break;
+    }
+} // matmult_tl
+
+/*
+ * The transpose of the tile-major T, stored tile-major in T_t (same n and bs;
+ * bs <= 0 selects LAYOUT_TILE).  Tile (ti, tj) of T is transposed into tile (tj, ti)
+ * of T_t, so each step reads one contiguous tile and writes another; the padding
+ * moves with its tile and stays zero.
+ */
+void transpose_tl(int n, int bs, double *T, double *T_t) {
+    if (bs <= 0) bs = LAYOUT_TILE;
+
+    int nt = (n + bs - 1) / bs;
+
+    for (int ti = 0; ti < nt; ti++) {
+        for (int tj = 0; tj < nt; tj++) {
+            double *src = tiled_tile(n, bs, T, ti, tj);
+            double *dst = tiled_tile(n, bs, T_t, tj, ti);
+
+            if (Simd.tr_tile) {
+                Simd.tr_tile(bs, src, dst, 0, 0, bs, bs);
+            } else {
+                for (int i = 0; i < bs; i++) {
+                    for (int j = 0; j < bs; j++) {
+                        dst[j * bs + i] = src[i * bs + j];
+                    }
+                }
+            }
+        }
+    }
+} // transpose_tl
@@ -0,0 +1,32 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+
+// Tile side the drivers use for the tile-major kernels when -b doesn't give one
+#define LAYOUT_TILE 64
+
+/*
+ * Tile-major storage.  An n x n matrix in tiles of side bs is stored as
+ * ceil(n / bs) x ceil(n / bs) tiles in row-major order of tiles; each tile is a
+ * bs x bs row-major block, contiguous in memory, and tiles on the bottom and right
+ * edges are padded with zeros.  This is the layout of the data in an out-of-core
+ * matrix file (see ooc.h), so one maps onto the other tile for tile.
+ *
+ * Element (i, j) lives in tile (i / bs, j / bs), at offset (i % bs) * bs + j % bs.
+ */
+static inline double *tiled_tile(int n, int bs, double *T, int ti, int tj) {
+    int nt = (n + bs - 1) / bs;
+    return T + ((size_t)ti * nt + tj) * bs * bs;
+}
+
+size_t tiled_count(int n, int bs);
+double *make_tiled_matrix(int n, int bs);
+
+void to_tiled(int n, int bs, double *M, double *T);
+void from_tiled(int n, int bs, double *T, double *M);
+
+void matmult_tl(int n, int bs, double *A, double *B, double *C);
+void transpose_tl(int n, int bs, double *T, double *T_t);
+
+#endif
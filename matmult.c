@@ -2,7 +2,8 @@
  *  matmult.c
  *  CS3410 (F'24)
  *
- *  USAGE:  matmult  <matrix_dimension>
+ *  USAGE:  matmult  [-b <block_size>] [-t <threads>] [-T <type>] [-N]
+ *                   [-w <warmup>] [-r <reps>] [-o csv|json] [-k <variant>] <matrix_dimension>
  *
  *  OVERVIEW:  Tests the performance of various cache-aware optimizations of matrix
  *     multiplication and reports the results.
@@ -14,10 +15,259 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
+#include "alloc.h"
+#include "bench.h"
 #include "helpers.h"
+#include "layout.h"
+#include "perf.h"
+#include "placement.h"
+#include "simd.h"
 #include "tasks.h"
+#include "threads.h"
+#include "tune.h"
+
+// How many times the batched benchmark multiplies each batch
+#define BATCH_REPS 10
+
+/*
+ * A field of /proc/self/status ("VmRSS:" for the resident set now, "VmHWM:" for
+ * its peak), in bytes, or -1 where /proc doesn't have it.
+ */
+static long proc_status_bytes(const char *field) {
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = -1;
+
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, field, strlen(field))) kb = atol(line + strlen(field));
+    }
+    fclose(f);
+    return (kb < 0) ? -1 : kb * 1024;
+} // proc_status_bytes
+
+/*
+ * Resets the peak resident set to the current one, and returns the current one in
+ * bytes, or -1 if the peak can't be reset (see proc(5), /proc/pid/clear_refs).
+ * Afterwards, proc_status_bytes("VmHWM:") less the result is how much memory
+ * whatever ran in between had at most.  (getrusage's ru_maxrss can't be reset,
+ * and also keeps the peak of threads that have exited.)
+ */
+static long reset_peak_rss(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    if (!f) return -1;
+    bool ok = fputs("5", f) >= 0;
+    if (fclose(f) || !ok) return -1;
+    return proc_status_bytes("VmRSS:");
+} // reset_peak_rss
+
+/*
+ * Prints the measured peak growth since reset_peak_rss returned `base`.
+ */
+static void print_peak_growth(long base) {
+    long peak = proc_status_bytes("VmHWM:");
+
+    if (base < 0 || peak < 0) {
+        printf("  peak memory = (unavailable here)\n");
+    } else {
+        printf("  peak memory = +%.1f MB\n", (peak > base ? peak - base : 0) / 1e6);
+    }
+} // print_peak_growth
+
+/*
+ * The benchmark for -T <type> other than double:  the blocked multiply from
+ * typed.c for that element type, against the same kernel for double.
+ */
+static void typed_benchmark(Args args) {
+    int n = args.n;
+    long long start, end;
+    unsigned long totals[2];
+    ElemType types[2] = {ELEM_F64, args.type};
+    double *M = malloc((size_t)n * n * sizeof(double));
+
+    // Small values, so that every type holds them, and their products, exactly
+    for (long i = 0; i < (long)n * n; i++) {
+        M[i] = (double)(i % 7 - 3);
+    }
+
+    for (int v = 0; v < 2; v++) {
+        void *A = make_typed_matrix(types[v], false, n, M);
+        void *B = make_typed_matrix(types[v], false, n, M);
+        void *C = make_typed_matrix(types[v], true, n, NULL);
+
+        start = timeInMilliseconds();
+        matmult_bl_typed(types[v], n, args.blocksz, A, B, C);
+        end = timeInMilliseconds();
+        totals[v] = end - start;
+
+        matrix_free(A);
+        matrix_free(B);
+        matrix_free(C);
+    }
+
+    printf("Time to calculate A*B = C, for %d x %d matrices A and B (%s kernels)\n", n, n, Simd.name);
+    printf("---------------------------------------------------------\n");
+    printf("  block size\t= %d\n", args.blocksz);
+    printf("---------------------------------------------------------\n");
+    for (int v = 0; v < 2; v++) {
+        printf("  TIME TO COMPLETION (blocked, %s) = %lu msec.\n", elem_name(types[v]), totals[v]);
+    }
+    printf("---------------------------------------------------------\n\n");
+    free(M);
+} // typed_benchmark
+
+/*
+ * The operands of the harness variants.  B_t is B transposed, for the realigned
+ * kernel; TA, TB and TC are A, B and C in tile-major storage.
+ */
+typedef struct mm_bench_t {
+    int n, bs, tl_bs, threads;
+    double *A, *B, *B_t, *C, *TA, *TB, *TC;
+} MMBench;
+
+static void mm_reset(void *p) {
+    MMBench *m = p;
+    zero(m->n, m->C);
+}
+
+static void mm_reset_tl(void *p) {
+    MMBench *m = p;
+    memset(m->TC, 0, tiled_count(m->n, m->tl_bs) * sizeof(double));
+}
+
+static void mm_naive(void *p) {
+    MMBench *m = p;
+    matmult(m->n, m->A, m->B, m->C);
+}
+
+static void mm_realigned(void *p) {
+    MMBench *m = p;
+    matmult_cm(m->n, m->A, m->B_t, m->C);
+}
+
+static void mm_interchange(void *p) {
+    MMBench *m = p;
+    matmult_li(m->n, m->A, m->B, m->C);
+}
+
+static void mm_blocked(void *p) {
+    MMBench *m = p;
+    matmult_bl(m->n, m->bs, m->A, m->B, m->C);
+}
+
+static void mm_blocked_mt(void *p) {
+    MMBench *m = p;
+    matmult_bl_mt(m->n, m->bs, m->threads, m->A, m->B, m->C);
+}
+
+static void mm_blocked_ws(void *p) {
+    MMBench *m = p;
+    matmult_bl_ws(m->n, m->bs, m->threads, m->A, m->B, m->C);
+}
+
+static void mm_tiled(void *p) {
+    MMBench *m = p;
+    matmult_tiled(m->n, m->A, m->B, m->C);
+}
+
+static void mm_packed(void *p) {
+    MMBench *m = p;
+    matmult_packed(m->n, m->A, m->B, m->C);
+}
+
+static void mm_recursive(void *p) {
+    MMBench *m = p;
+    matmult_rec(m->n, m->A, m->B, m->C);
+}
+
+static void mm_strassen(void *p) {
+    MMBench *m = p;
+    matmult_strassen(m->n, m->A, m->B, m->C);
+}
+
+static void mm_gemm(void *p) {
+    MMBench *m = p;
+    gemm(false, false, m->n, m->n, m->n, 1.0, m->A, m->n, m->B, m->n, 0.0, m->C, m->n);
+}
+
+static void mm_fused(void *p) {
+    MMBench *m = p;
+    matmult_fused(m->n, m->threads, m->A, m->B, m->C);
+}
+
+static void mm_tile_major(void *p) {
+    MMBench *m = p;
+    matmult_tl(m->n, m->tl_bs, m->TA, m->TB, m->TC);
+}
+
+// Every variant the harness knows, by the name -k selects it with
+static const struct {
+    const char *name;
+    BenchFn run, reset;
+} MM_Variants[] = {
+    {"naive", mm_naive, mm_reset},
+    {"realigned", mm_realigned, mm_reset},
+    {"interchange", mm_interchange, mm_reset},
+    {"blocked", mm_blocked, mm_reset},
+    {"blocked-mt", mm_blocked_mt, mm_reset},
+    {"blocked-ws", mm_blocked_ws, mm_reset},
+    {"tiled", mm_tiled, mm_reset},
+    {"packed", mm_packed, mm_reset},
+    {"fused", mm_fused, mm_reset},
+    {"recursive", mm_recursive, mm_reset},
+    {"strassen", mm_strassen, mm_reset},
+    {"gemm", mm_gemm, NULL},
+    {"tile-major", mm_tile_major, mm_reset_tl},
+};
+
+/*
+ * The benchmark harness (-o):  each variant (or just -k's) gets -w warmup runs and
+ * -r timed runs, with the caches flushed before each, and one record of the
+ * min/median/p95 times on stdout.  The console tables are skipped.
+ */
+static void harness(Args args) {
+    int n = args.n, count = sizeof(MM_Variants) / sizeof(MM_Variants[0]);
+    MMBench m = {
+        .n = n, .bs = args.blocksz, .tl_bs = (args.blocksz > 1 ? args.blocksz : LAYOUT_TILE),
+        .threads = num_threads(args.threads),
+        .A = make_one_matrix(n), .B = make_one_matrix(n), .B_t = make_one_matrix(n), .C = make_one_matrix(n),
+    };
+    bool found = false;
+
+    transpose(n, m.B, m.B_t);
+    m.TA = make_tiled_matrix(n, m.tl_bs);
+    m.TB = make_tiled_matrix(n, m.tl_bs);
+    m.TC = make_tiled_matrix(n, m.tl_bs);
+    to_tiled(n, m.tl_bs, m.A, m.TA);
+    to_tiled(n, m.tl_bs, m.B, m.TB);
+
+    bench_emit_header(stdout, args.format);
+    for (int v = 0; v < count; v++) {
+        if (args.kernel && strcmp(args.kernel, MM_Variants[v].name)) continue;
+        found = true;
+
+        BenchRecord rec = {
+            .program = "matmult", .variant = MM_Variants[v].name, .n = n,
+            .blocksz = (MM_Variants[v].run == mm_tile_major ? m.tl_bs : args.blocksz),
+            .threads = m.threads, .simd = Simd.name, .flops = 2.0 * n * n * n, .bytes = 0,
+        };
+        rec.stats = bench_run(MM_Variants[v].run, MM_Variants[v].reset, &m, args.warmup, args.reps);
+        bench_emit(stdout, args.format, &rec);
+    }
+    if (!found) fprintf(stderr, "No variant named %s.\n", args.kernel);
+
+    matrix_free(m.A);
+    matrix_free(m.B);
+    matrix_free(m.B_t);
+    matrix_free(m.C);
+    matrix_free(m.TA);
+    matrix_free(m.TB);
+    matrix_free(m.TC);
+} // harness
 
 int main(int argc, char **argv) {
     double *A, *B, *C;
@@ -25,10 +275,23 @@ int main(int argc, char **argv) {
     MMTotals mmt;
     // The time to completion of A*B = C, in seconds
 
-    int n = get_arg(argc, argv);
+    Args args = get_args(argc, argv);
+    int n = args.n;
 
     bool verbose = n <= 8; // Should we display the matrix calculation, too?
 
+    // Resolve the default block size here, so the reports show the one in use
+    if (args.blocksz <= 0) args.blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    if (args.format != BENCH_CONSOLE) {
+        harness(args);
+        return 0;
+    }
+    if (args.type != ELEM_F64) {
+        typed_benchmark(args);
+        return 0;
+    }
+
     // Set up and run timing for unoptimized matrix multiplication:
 
     printf("\n(creating test matrices ...");
@@ -40,39 +303,77 @@ int main(int argc, char **argv) {
     printf(" performing benchmark ...");
     fflush(stdout);
 
+    // The four classic variants are instrumented (see perf.h); the rest are timed to
+    // the millisecond, as before.
+    PerfSession perf;
+    PerfSample s_basic, s_cm, s_li, s_bl;
+
+    perf_open(&perf);
+
     zero(n, C); // All `matmult*` functions expect C to be initialized to 0.
-    start = timeInMilliseconds();
+    perf_start(&perf);
     matmult(n, A, B, C);
-    end = timeInMilliseconds();
-    mmt.total_basic = end - start;
+    s_basic = perf_stop(&perf);
+    mmt.total_basic = s_basic.ns / 1000000;
 
     zero(n, C);
-    start = timeInMilliseconds();
+    perf_start(&perf);
     matmult_li(n, A, B, C);
+    s_li = perf_stop(&perf);
+    mmt.total_li = s_li.ns / 1000000;
+
+    // Now try with B realigned to column-major representation.  B is transposed in
+    // place (rather than into a second n x n buffer), and restored afterwards:
+    transpose_inplace_mt(n, args.threads, B);
+
+    zero(n, C);
+    perf_start(&perf);
+    matmult_cm(n, A, B, C);
+    s_cm = perf_stop(&perf);
+    mmt.total_cm = s_cm.ns / 1000000;
+
+    transpose_inplace_mt(n, args.threads, B);
+
+    zero(n, C);
+    perf_start(&perf);
+    matmult_bl(n, args.blocksz, A, B, C);
+    s_bl = perf_stop(&perf);
+    mmt.total_bl = s_bl.ns / 1000000;
+
+    zero(n, C);
+    start = timeInMilliseconds();
+    matmult_tiled(n, A, B, C);
     end = timeInMilliseconds();
-    mmt.total_li = end - start;
+    mmt.total_tiled = end - start;
 
-    // Now try with B realigned to column-major representation:
-    double *B_t = make_one_matrix(n);
-    zero(n, B_t);
-    transpose(n, B, B_t);
+    zero(n, C);
+    start = timeInMilliseconds();
+    matmult_packed(n, A, B, C);
+    end = timeInMilliseconds();
+    mmt.total_pk = end - start;
 
     zero(n, C);
     start = timeInMilliseconds();
-    matmult_cm(n, A, B_t, C);
+    matmult_rec(n, A, B, C);
     end = timeInMilliseconds();
-    mmt.total_cm = end - start;
+    mmt.total_rec = end - start;
 
     zero(n, C);
     start = timeInMilliseconds();
-    matmult_bl(n, A, B, C);
+    matmult_strassen(n, A, B, C);
     end = timeInMilliseconds();
-    mmt.total_bl = end - start;
+    mmt.total_sw = end - start;
+
+    // No zero(n, C) here:  with beta = 0, gemm overwrites C without reading it.
+    start = timeInMilliseconds();
+    gemm(false, false, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+    end = timeInMilliseconds();
+    mmt.total_gemm = end - start;
 
     printf(" done)\n\n");
 
     // Not strictly valid timing, since we're including function call/return overhead.
-    printf("Time to calculate A*B = C, for %d x %d matrices A and B\n", n, n);
+    printf("Time to calculate A*B = C, for %d x %d matrices A and B (%s kernels)\n", n, n, Simd.name);
     if (verbose) {
         // printf("----------------------------------------------------------\n");
         printf("\n");
@@ -80,7 +381,266 @@ int main(int argc, char **argv) {
         printf("\n");
     }
 
-    print_results_matmult(BLOCKSZ, mmt);
+    print_results_matmult(args.blocksz, mmt);
+
+    // GFLOP/s against the memory traffic measured from LLC misses, per variant
+    double flops = 2.0 * n * n * n;
+
+    printf("Hardware counters%s\n", (perf_available(&perf) ? "" : " (unavailable here: timing only)"));
+    printf("---------------------------------------------------------\n");
+    print_results_perf("naive", s_basic, flops, 0);
+    print_results_perf("realigned", s_cm, flops, 0);
+    print_results_perf("interchange", s_li, flops, 0);
+    print_results_perf("blocked", s_bl, flops, 0);
+    printf("---------------------------------------------------------\n\n");
+    perf_close(&perf);
+
+    // Row-major against tile-major storage, end to end:  the blocked kernel on the
+    // row-major operands, against converting A and B to tiles, multiplying them in
+    // place, and converting C back.  Both use the same tile size (-b, when it's more
+    // than 1, else LAYOUT_TILE).
+    int tl_bs = (args.blocksz > 1 ? args.blocksz : LAYOUT_TILE);
+    double *TA = make_tiled_matrix(n, tl_bs), *TB = make_tiled_matrix(n, tl_bs);
+    double *TC = make_tiled_matrix(n, tl_bs);
+    double *C_tl = make_one_matrix(n);
+    unsigned long total_rm, total_in, total_tl, total_out;
+
+    zero(n, C);
+    start = timeInMilliseconds();
+    matmult_bl(n, tl_bs, A, B, C);
+    end = timeInMilliseconds();
+    total_rm = end - start;
+
+    start = timeInMilliseconds();
+    to_tiled(n, tl_bs, A, TA);
+    to_tiled(n, tl_bs, B, TB);
+    end = timeInMilliseconds();
+    total_in = end - start;
+
+    start = timeInMilliseconds();
+    matmult_tl(n, tl_bs, TA, TB, TC);
+    end = timeInMilliseconds();
+    total_tl = end - start;
+
+    start = timeInMilliseconds();
+    from_tiled(n, tl_bs, TC, C_tl);
+    end = timeInMilliseconds();
+    total_out = end - start;
+
+    printf("Row-major vs. tile-major storage (tile = %d)\n", tl_bs);
+    printf("---------------------------------------------------------\n");
+    printf("  row-major blocked\t\t= %lu msec.\n", total_rm);
+    printf("  tile-major:  convert A, B\t= %lu msec.\n", total_in);
+    printf("               multiply\t\t= %lu msec.\n", total_tl);
+    printf("               convert C\t= %lu msec.\n", total_out);
+    printf("               total\t\t= %lu msec.\n", total_in + total_tl + total_out);
+    printf("  max |diff| between the two = %g\n", max_abs_diff(n, C, C_tl));
+    printf("---------------------------------------------------------\n\n");
+    matrix_free(TA);
+    matrix_free(TB);
+    matrix_free(TC);
+    matrix_free(C_tl);
+
+    // The two-phase flow, transpose(n, B, B_t) into a second n x n buffer and then
+    // matmult_cm, against matmult_fused, which packs B a panel at a time as it goes,
+    // on one thread and on all of them.  The peak memory of each is measured from
+    // the resident set, over the operands already in memory:  B_t for the one, the
+    // panel buffers for the other.
+    int max_threads = num_threads(args.threads);
+    unsigned long total_transpose, total_cm, total_fused[2];
+    long base;
+
+    zero(n, C);
+    base = reset_peak_rss();
+    start = timeInMilliseconds();
+    double *B_t = matrix_alloc((size_t)n * n * sizeof(double)); // written once, by the transpose
+    transpose(n, B, B_t);
+    end = timeInMilliseconds();
+    total_transpose = end - start;
+
+    start = timeInMilliseconds();
+    matmult_cm(n, A, B_t, C);
+    end = timeInMilliseconds();
+    total_cm = end - start;
+
+    printf("Two-phase (transpose + realigned) vs. fused (kc = %d, nc = %d)\n", Tile_Sizes.kc, Tile_Sizes.nc);
+    printf("---------------------------------------------------------\n");
+    printf("  two-phase:  transpose\t= %lu msec.\n", total_transpose);
+    printf("              multiply\t= %lu msec.\n", total_cm);
+    printf("              total\t= %lu msec.", total_transpose + total_cm);
+    print_peak_growth(base);
+    matrix_free(B_t);
+
+    double *C_fu = make_one_matrix(n);
+    double diff = 0.0;
+
+    for (int v = 0; v < (max_threads > 1 ? 2 : 1); v++) {
+        int threads = (v == 0 ? 1 : max_threads);
+
+        zero(n, C_fu);
+        base = reset_peak_rss();
+        start = timeInMilliseconds();
+        matmult_fused(n, threads, A, B, C_fu);
+        end = timeInMilliseconds();
+        total_fused[v] = end - start;
+
+        printf("  %-10s  %d thread%s\t= %lu msec.", (v == 0 ? "fused:" : ""), threads, (threads == 1 ? "" : "s"),
+               total_fused[v]);
+        print_peak_growth(base);
+        double d = max_abs_diff(n, C, C_fu);
+        if (!(d <= diff)) diff = d;
+    }
+    printf("  max |diff| between the two = %g\n", diff);
+    printf("---------------------------------------------------------\n\n");
+    matrix_free(C_fu);
+
+    // Structured multiplies:  A * A' by transposing into A_t and running matmult_bl
+    // on all n^2 outputs, against syrk's one triangle (and then its mirror); and a
+    // lower-triangular T * B (T = A, upper triangle ignored) by matmult_bl on T with
+    // its upper triangle zeroed, against trmm.
+    double *A_t = make_one_matrix(n), *T_z = make_one_matrix(n);
+    unsigned long total_full, total_syrk, total_mirror, total_dense, total_trmm;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            T_z[i * n + j] = (j <= i ? A[i * n + j] : 0.0);
+        }
+    }
+
+    zero(n, C);
+    start = timeInMilliseconds();
+    transpose_bl(n, args.blocksz, A, A_t);
+    matmult_bl(n, args.blocksz, A, A_t, C);
+    end = timeInMilliseconds();
+    total_full = end - start;
+
+    zero(n, A_t);
+    start = timeInMilliseconds();
+    syrk(n, args.blocksz, false, A, A_t);
+    end = timeInMilliseconds();
+    total_syrk = end - start;
+
+    zero(n, A_t);
+    start = timeInMilliseconds();
+    syrk(n, args.blocksz, true, A, A_t);
+    end = timeInMilliseconds();
+    total_mirror = end - start;
+    double d_syrk = max_abs_diff(n, C, A_t);
+
+    zero(n, C);
+    start = timeInMilliseconds();
+    matmult_bl(n, args.blocksz, T_z, B, C);
+    end = timeInMilliseconds();
+    total_dense = end - start;
+
+    zero(n, A_t);
+    start = timeInMilliseconds();
+    trmm(false, n, args.blocksz, A, B, A_t);
+    end = timeInMilliseconds();
+    total_trmm = end - start;
+
+    printf("Symmetric and triangular multiplies (block size = %d)\n", args.blocksz);
+    printf("---------------------------------------------------------\n");
+    printf("  A*A':  transpose + blocked\t= %lu msec.\n", total_full);
+    printf("         syrk (lower only)\t= %lu msec.\n", total_syrk);
+    printf("         syrk (mirrored)\t= %lu msec.  max |diff| = %g\n", total_mirror, d_syrk);
+    printf("  T*B:   blocked (dense T)\t= %lu msec.\n", total_dense);
+    printf("         trmm\t\t\t= %lu msec.  max |diff| = %g\n", total_trmm, max_abs_diff(n, C, A_t));
+    printf("---------------------------------------------------------\n\n");
+    matrix_free(A_t);
+    matrix_free(T_z);
+
+    // Where Strassen-Winograd starts to pay off:  the same multiply with the crossover
+    // halved each time, from n (no recursion, i.e. the packed kernel) down to 64.
+    int crossover = Strassen_Crossover;
+
+    printf("Strassen-Winograd vs. crossover\n");
+    printf("---------------------------------------------------------\n");
+    for (int c = n; c >= 64 || c == n; c /= 2) {
+        Strassen_Crossover = c;
+        zero(n, C);
+        start = timeInMilliseconds();
+        matmult_strassen(n, A, B, C);
+        end = timeInMilliseconds();
+        printf("  crossover = %5d  TIME TO COMPLETION = %lld msec.%s\n", c, end - start,
+               (c == n ? "  (no recursion)" : ""));
+    }
+    printf("---------------------------------------------------------\n\n");
+    Strassen_Crossover = crossover;
+
+    // Scaling of the multithreaded blocked kernels, from 1 thread up to -t (or one
+    // per CPU), doubling each time.  The serial result is the reference, since
+    // every thread count must reproduce it exactly.
+    void (*mt_kernels[])(int, int, int, double *, double *, double *) = {matmult_bl_mt, matmult_bl_ws};
+    const char *mt_names[] = {"static", "work-stealing"};
+    double *C_mt = make_one_matrix(n);
+
+    zero(n, C);
+    matmult_bl(n, args.blocksz, A, B, C);
+
+    for (int v = 0; v < 2; v++) {
+        unsigned long total_one = 0;
+
+        printf("Multithreaded blocked multiplication, %s (block size = %d, NUMA placement %s, %d node%s)\n",
+               mt_names[v], args.blocksz, (Numa_Placement ? "on" : "off"), numa_nodes(),
+               (numa_nodes() == 1 ? "" : "s"));
+        printf("---------------------------------------------------------\n");
+        for (int t = 1;; t = (t * 2 < max_threads ? t * 2 : max_threads)) {
+            zero(n, C_mt);
+            start = timeInMilliseconds();
+            mt_kernels[v](n, args.blocksz, t, A, B, C_mt);
+            end = timeInMilliseconds();
+            if (t == 1) total_one = end - start;
+
+            print_results_threads(t, total_one, end - start, !memcmp(C, C_mt, n * n * sizeof(double)));
+            if (t == max_threads) break;
+        }
+        printf("---------------------------------------------------------\n\n");
+    }
+
+    // Many tiny multiplies:  one matmult_bl call per matrix, against one call to
+    // matmult_batched for the whole batch.  Each batch holds about 8 MB of each
+    // operand; the batched kernel is run BATCH_REPS times over it, the (much
+    // slower) loop of matmult_bl calls just once.
+    int sizes[] = {4, 8, 16, 32};
+
+    printf("Batched small multiplies (%d threads)\n", max_threads);
+    printf("---------------------------------------------------------\n");
+    for (int s = 0; s < 4; s++) {
+        int sz = sizes[s], count = (1 << 20) / (sz * sz);
+        double *As = matrix_alloc((size_t)count * sz * sz * sizeof(double));
+        double *Bs = matrix_alloc((size_t)count * sz * sz * sizeof(double));
+        double *Cs = matrix_alloc((size_t)count * sz * sz * sizeof(double));
+
+        for (long i = 0; i < (long)count * sz * sz; i++) {
+            As[i] = (double)(i % 7);
+            Bs[i] = (double)(i % 5);
+        }
+
+        start = timeInMilliseconds();
+        for (int b = 0; b < count; b++) {
+            zero(sz, Cs + b * sz * sz);
+            matmult_bl(sz, args.blocksz, As + b * sz * sz, Bs + b * sz * sz, Cs + b * sz * sz);
+        }
+        end = timeInMilliseconds();
+        print_results_batched("(matmult_bl)", sz, count, end - start);
+
+        start = timeInMilliseconds();
+        for (int r = 0; r < BATCH_REPS; r++) {
+            matmult_batched_strided(count, sz, args.threads, As, sz * sz, Bs, sz * sz, Cs, sz * sz);
+        }
+        end = timeInMilliseconds();
+        print_results_batched("(batched)", sz, (long)count * BATCH_REPS, end - start);
+
+        matrix_free(As);
+        matrix_free(Bs);
+        matrix_free(Cs);
+    }
+    printf("---------------------------------------------------------\n\n");
 
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(C_mt);
     return 0;
 } // main
@@ -0,0 +1,324 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "ooc.h"
+#include "tasks.h"
+#include "typed.h"
+
+// How many tiles ahead of the one in use the streaming kernels ask the kernel to read
+#define OOC_LOOKAHEAD 2
+
+// Block size for transposing one tile in memory, for the element types other than
+// double (which use transpose_rec)
+#define OOC_TR_BLOCK 32
+
+static size_t round_up(size_t x, size_t m) {
+    return (x + m - 1) / m * m;
+}
+
+/*
+ * Fills in the derived fields of M from M->hdr, and maps the file.  Returns 0, or
+ * -1 with errno set.
+ */
+static int ooc_map(OocMatrix *M) {
+    OocHeader *h = &M->hdr;
+
+    M->tile_rows = (long)((h->rows + h->tile - 1) / h->tile);
+    M->tile_cols = (long)((h->cols + h->tile - 1) / h->tile);
+    M->tile_bytes = h->tile * h->tile * elem_size(h->type, false);
+    M->map_len = h->data_offset + M->tile_rows * M->tile_cols * M->tile_bytes;
+    M->map = mmap(NULL, M->map_len, PROT_READ | (M->writable ? PROT_WRITE : 0), MAP_SHARED, M->fd, 0);
+    if (M->map == MAP_FAILED) {
+        M->map = NULL;
+        return -1;
+    }
+    return 0;
+} // ooc_map
+
+/*
+ * Creates (or truncates) the file at `path` for a rows x cols matrix of `type`,
+ * stored in tile x tile tiles (<= 0 selects OOC_TILE), and opens it for writing.
+ * Every element starts out zero; the file is sparse until written.  Returns 0, or
+ * -1 with errno set.
+ */
+int ooc_create(OocMatrix *M, const char *path, ElemType type, long rows, long cols, long tile) {
+    if (tile <= 0) tile = OOC_TILE;
+    if (rows <= 0 || cols <= 0 || type < 0 || type >= ELEM_TYPES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(M, 0, sizeof(*M));
+    memcpy(M->hdr.magic, OOC_MAGIC, sizeof(M->hdr.magic));
+    M->hdr.version = OOC_VERSION;
+    M->hdr.type = type;
+    M->hdr.rows = rows;
+    M->hdr.cols = cols;
+    M->hdr.tile = tile;
+    M->hdr.data_offset = round_up(sizeof(OocHeader), sysconf(_SC_PAGESIZE));
+    M->writable = true;
+
+    M->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (M->fd < 0) return -1;
+
+    size_t tiles = (size_t)((rows + tile - 1) / tile) * ((cols + tile - 1) / tile);
+    size_t length = M->hdr.data_offset + tiles * tile * tile * elem_size(type, false);
+    if (ftruncate(M->fd, length) || ooc_map(M)) {
+        int err = errno;
+        close(M->fd);
+        M->fd = -1;
+        errno = err;
+        return -1;
+    }
+    memcpy(M->map, &M->hdr, sizeof(M->hdr));
+    return 0;
+} // ooc_create
+
+/*
+ * Opens an existing matrix file, read-only unless `writable`.  Returns 0, or -1
+ * with errno set (EINVAL if it isn't a matrix file this version understands).
+ */
+int ooc_open(OocMatrix *M, const char *path, bool writable) {
+    struct stat st;
+
+    memset(M, 0, sizeof(*M));
+    M->writable = writable;
+    M->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (M->fd < 0) return -1;
+
+    if (pread(M->fd, &M->hdr, sizeof(M->hdr), 0) != sizeof(M->hdr) ||
+        memcmp(M->hdr.magic, OOC_MAGIC, sizeof(M->hdr.magic)) || M->hdr.version != OOC_VERSION ||
+        M->hdr.type >= ELEM_TYPES || !M->hdr.tile || fstat(M->fd, &st)) {
+        close(M->fd);
+        M->fd = -1;
+        errno = EINVAL;
+        return -1;
+    }
+    if (ooc_map(M)) {
+        int err = errno;
+        close(M->fd);
+        M->fd = -1;
+        errno = err;
+        return -1;
+    }
+    if ((size_t)st.st_size < M->map_len) { // truncated
+        ooc_close(M);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+} // ooc_open
+
+/*
+ * Writes back anything still dirty, and closes the file.  Returns 0, or -1 with
+ * errno set if the write-back failed.
+ */
+int ooc_close(OocMatrix *M) {
+    int status = 0;
+
+    if (M->map) {
+        if (M->writable && msync(M->map, M->map_len, MS_SYNC)) status = -1;
+        munmap(M->map, M->map_len);
+    }
+    if (M->fd >= 0) close(M->fd);
+    M->map = NULL;
+    M->fd = -1;
+    return status;
+} // ooc_close
+
+/*
+ * The tile at tile row ti, tile column tj:  a tile x tile row-major block.
+ */
+void *ooc_tile(OocMatrix *M, long ti, long tj) {
+    return M->map + M->hdr.data_offset + (ti * M->tile_cols + tj) * M->tile_bytes;
+} // ooc_tile
+
+/*
+ * Element (i, j) of M, converted to double:  for spot checks, not for bulk access.
+ */
+double ooc_get(OocMatrix *M, long i, long j) {
+    long t = M->hdr.tile;
+    char *tile = ooc_tile(M, i / t, j / t);
+    long k = (i % t) * t + j % t;
+
+    switch (M->hdr.type) {
+    case ELEM_F64: return ((double *)tile)[k];
+    case ELEM_F32: return ((float *)tile)[k];
+    case ELEM_I32: return ((int32_t *)tile)[k];
+    default:       return ((int8_t *)tile)[k];
+    }
+} // ooc_get
+
+/*
+ * Applies `advice` to the whole pages of the mapping that overlap tile (ti, tj).
+ */
+static void ooc_advise(OocMatrix *M, long ti, long tj, int advice) {
+    if (ti < 0 || ti >= M->tile_rows || tj < 0 || tj >= M->tile_cols) return;
+
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)ooc_tile(M, ti, tj) / page * page;
+    uintptr_t end = round_up((uintptr_t)ooc_tile(M, ti, tj) + M->tile_bytes, page);
+    madvise((void *)start, end - start, advice);
+} // ooc_advise
+
+/*
+ * Starts reading tile (ti, tj) in from disk in the background, so that it is
+ * (ideally) resident by the time it is used.  Out-of-range tiles are ignored.
+ */
+void ooc_prefetch(OocMatrix *M, long ti, long tj) {
+    ooc_advise(M, ti, tj, MADV_WILLNEED);
+} // ooc_prefetch
+
+/*
+ * Done with tile (ti, tj) for now:  if `dirty`, starts writing it back, and then
+ * drops it from this process's memory, so that a pass over a matrix bigger than
+ * RAM doesn't push everything else out.  The data is not lost; the next access
+ * reads it back from the page cache or the file.
+ */
+void ooc_evict(OocMatrix *M, long ti, long tj, bool dirty) {
+    if (ti < 0 || ti >= M->tile_rows || tj < 0 || tj >= M->tile_cols) return;
+
+    if (dirty) {
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)ooc_tile(M, ti, tj) / page * page;
+        uintptr_t end = round_up((uintptr_t)ooc_tile(M, ti, tj) + M->tile_bytes, page);
+        msync((void *)start, end - start, MS_ASYNC);
+    }
+    ooc_advise(M, ti, tj, MADV_DONTNEED);
+} // ooc_evict
+
+/*
+ * Copies between a row-major matrix in memory (rows x cols elements of the file's
+ * type) and the file's tiles, for matrices that do fit in RAM.  `to_file` selects
+ * the direction.
+ */
+static void ooc_copy(OocMatrix *M, char *rm, bool to_file) {
+    size_t es = elem_size(M->hdr.type, false);
+    long rows = M->hdr.rows, cols = M->hdr.cols, t = M->hdr.tile;
+
+    for (long ti = 0; ti < M->tile_rows; ti++) {
+        for (long tj = 0; tj < M->tile_cols; tj++) {
+            char *tile = ooc_tile(M, ti, tj);
+            long ilen = (rows - ti * t < t) ? rows - ti * t : t;
+            long jlen = (cols - tj * t < t) ? cols - tj * t : t;
+
+            for (long i = 0; i < ilen; i++) {
+                char *row = rm + ((ti * t + i) * cols + tj * t) * es;
+                if (to_file) {
+                    memcpy(tile + i * t * es, row, jlen * es);
+                } else {
+                    memcpy(row, tile + i * t * es, jlen * es);
+                }
+            }
+        }
+    }
+} // ooc_copy
+
+/*
+ * Stores the row-major matrix at src into M, which must be writable.
+ */
+void ooc_store(OocMatrix *M, void *src) {
+    ooc_copy(M, src, true);
+} // ooc_store
+
+/*
+ * Loads M into the row-major matrix at dst.
+ */
+void ooc_load(OocMatrix *M, void *dst) {
+    ooc_copy(M, dst, false);
+} // ooc_load
+
+/*
+ * Out of core:  M_t = the transpose of M, both on disk.  M_t must be writable and
+ * cols x rows, with the same element type and tile size as M.  Tiles of M are read
+ * in file order, each one OOC_LOOKAHEAD tiles after it is asked for; each is
+ * transposed in memory (for doubles, by transpose_rec) straight into its place in
+ * M_t, which is then written back and both are dropped from memory.  Returns 0, or
+ * -1 with errno set to EINVAL if the shapes don't match.
+ */
+int ooc_transpose(OocMatrix *M, OocMatrix *M_t) {
+    OocHeader *h = &M->hdr, *ht = &M_t->hdr;
+    long t = h->tile;
+
+    if (!M_t->writable || ht->rows != h->cols || ht->cols != h->rows || ht->type != h->type ||
+        ht->tile != h->tile) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    long ntiles = M->tile_rows * M->tile_cols;
+    madvise(M->map, M->map_len, MADV_SEQUENTIAL);
+    for (long k = 0; k < OOC_LOOKAHEAD && k < ntiles; k++) {
+        ooc_prefetch(M, k / M->tile_cols, k % M->tile_cols);
+    }
+    for (long k = 0; k < ntiles; k++) {
+        long ti = k / M->tile_cols, tj = k % M->tile_cols;
+        long next = k + OOC_LOOKAHEAD;
+
+        if (next < ntiles) ooc_prefetch(M, next / M->tile_cols, next % M->tile_cols);
+        if (h->type == ELEM_F64) {
+            transpose_rec(t, ooc_tile(M, ti, tj), ooc_tile(M_t, tj, ti));
+        } else {
+            transpose_bl_typed(h->type, t, OOC_TR_BLOCK, ooc_tile(M, ti, tj), ooc_tile(M_t, tj, ti));
+        }
+        ooc_evict(M_t, tj, ti, true);
+        ooc_evict(M, ti, tj, false);
+    }
+    return 0;
+} // ooc_transpose
+
+/*
+ * Out of core:  C = A * B, all three on disk and of doubles, with one tile size.  A
+ * is m x k, B k x n and C m x n (and writable).  Each tile of C is computed in
+ * place as the sum over p of A(i, p) * B(p, j), tile by tile, by gemm; the next
+ * pair of input tiles is prefetched while the current pair is multiplied.  A's
+ * tiles for one tile row of C are reused across it, so A is read once, and B once
+ * per tile row of C.  Returns 0, or -1 with errno set to EINVAL if the shapes
+ * don't match.
+ */
+int ooc_matmult(OocMatrix *A, OocMatrix *B, OocMatrix *C) {
+    long t = A->hdr.tile;
+
+    if (!C->writable || A->hdr.type != ELEM_F64 || B->hdr.type != ELEM_F64 || C->hdr.type != ELEM_F64 ||
+        B->hdr.tile != A->hdr.tile || C->hdr.tile != A->hdr.tile || A->hdr.cols != B->hdr.rows ||
+        C->hdr.rows != A->hdr.rows || C->hdr.cols != B->hdr.cols) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    long kt = A->tile_cols;
+    for (long i = 0; i < C->tile_rows; i++) {
+        for (long j = 0; j < C->tile_cols; j++) {
+            double *Ct = ooc_tile(C, i, j);
+
+            ooc_prefetch(A, i, 0);
+            ooc_prefetch(B, 0, j);
+            for (long p = 0; p < kt; p++) {
+                // The next pair:  along k, or the start of the next tile of C
+                if (p + 1 < kt) {
+                    ooc_prefetch(A, i, p + 1);
+                    ooc_prefetch(B, p + 1, j);
+                } else {
+                    ooc_prefetch(B, 0, (j + 1) % C->tile_cols);
+                }
+                // Padding tiles are zero, so whole tiles can be multiplied
+                gemm(false, false, t, t, t, 1.0, ooc_tile(A, i, p), t, ooc_tile(B, p, j), t,
+                     (p == 0 ? 0.0 : 1.0), Ct, t);
+                ooc_evict(B, p, j, false);
+            }
+            ooc_evict(C, i, j, true);
+        }
+        for (long p = 0; p < kt; p++) {
+            ooc_evict(A, i, p, false);
+        }
+    }
+    return 0;
+} // ooc_matmult
@@ -0,0 +1,60 @@
+#ifndef OOC_H
+#define OOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "typed.h"
+
+// Default tile side for new files:  a 512 x 512 tile of doubles is one 2 MB huge page
+#define OOC_TILE 512
+
+/*
+ * The on-disk matrix format.  A file is this header, padded out to
+ * header.data_offset bytes (a multiple of the page size), followed by the tiles:
+ * ceil(rows / tile) x ceil(cols / tile) of them, in row-major order of tiles.  Each
+ * tile is a tile x tile row-major block, so it is one contiguous run of the file;
+ * tiles on the bottom and right edges are padded with zeros.  All fields are in
+ * the host's byte order.
+ */
+typedef struct ooc_header_t {
+    char magic[8];        // OOC_MAGIC
+    uint32_t version;     // OOC_VERSION
+    uint32_t type;        // ElemType of the elements
+    uint64_t rows, cols;  // dimensions of the matrix
+    uint64_t tile;        // side of a tile, in elements
+    uint64_t data_offset; // bytes from the start of the file to the first tile
+} OocHeader;
+
+#define OOC_MAGIC "CBMATRIX"
+#define OOC_VERSION 1
+
+// An open, memory-mapped matrix file
+typedef struct ooc_matrix_t {
+    int fd;
+    bool writable;
+    OocHeader hdr;
+    char *map;         // the whole file, mapped shared
+    size_t map_len;
+    long tile_rows;    // tiles down, ceil(rows / tile)
+    long tile_cols;    // tiles across, ceil(cols / tile)
+    size_t tile_bytes; // bytes per tile
+} OocMatrix;
+
+int ooc_create(OocMatrix *M, const char *path, ElemType type, long rows, long cols, long tile);
+int ooc_open(OocMatrix *M, const char *path, bool writable);
+int ooc_close(OocMatrix *M);
+
+void *ooc_tile(OocMatrix *M, long ti, long tj);
+double ooc_get(OocMatrix *M, long i, long j);
+void ooc_prefetch(OocMatrix *M, long ti, long tj);
+void ooc_evict(OocMatrix *M, long ti, long tj, bool dirty);
+
+void ooc_store(OocMatrix *M, void *src);
+void ooc_load(OocMatrix *M, void *dst);
+
+int ooc_transpose(OocMatrix *M, OocMatrix *M_t);
+int ooc_matmult(OocMatrix *A, OocMatrix *B, OocMatrix *C);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ *  outofcore.c
+ *  CS3410 (F'24)
+ *
+ *  USAGE:  outofcore  [-b <tile_size>] [-T <type>] <matrix_dimension> [<directory>]
+ *
+ *  OVERVIEW:  Tests the performance of the out-of-core (memory-mapped, tiled
+ *     file) transpose and multiply, on matrices created in <directory> (default:
+ *     the current one) and deleted afterwards.  These need not fit in RAM; only a
+ *     few tiles are resident at a time.  The tile size defaults to OOC_TILE when
+ *     no block size is given (that is, when it is 1).
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "ooc.h"
+
+// The multiply is O(n^3), so only run it up to this size
+#define OOC_MATMULT_MAX 8192
+
+// How many elements of each result to spot-check
+#define OOC_CHECKS 16
+
+/*
+ * Creates the n x n matrix file `path`, with M[i][j] = (i * n + j + 1) modulo what
+ * the type holds, written one tile at a time, as make_one_matrix would for a
+ * matrix too big to build in memory.  Exits on failure.
+ */
+static void make_file_matrix(OocMatrix *M, const char *path, ElemType type, long n, long tile) {
+    if (ooc_create(M, path, type, n, n, tile)) {
+        perror(path);
+        exit(1);
+    }
+    for (long ti = 0; ti < M->tile_rows; ti++) {
+        for (long tj = 0; tj < M->tile_cols; tj++) {
+            char *T = ooc_tile(M, ti, tj);
+
+            for (long i = ti * tile; i < (ti + 1) * tile && i < n; i++) {
+                for (long j = tj * tile; j < (tj + 1) * tile && j < n; j++) {
+                    long k = (i - ti * tile) * tile + (j - tj * tile);
+                    long v = i * n + j + 1;
+
+                    switch (type) {
+                    case ELEM_F64: ((double *)T)[k] = (double)v; break;
+                    case ELEM_F32: ((float *)T)[k] = (float)(v % (1 << 24)); break;
+                    case ELEM_I32: ((int32_t *)T)[k] = (int32_t)(v % INT32_MAX); break;
+                    default:       ((int8_t *)T)[k] = (int8_t)(v % 128); break;
+                    }
+                }
+            }
+            ooc_evict(M, ti, tj, true);
+        }
+    }
+} // make_file_matrix
+
+int main(int argc, char **argv) {
+    long long start, end;
+
+    Args args = get_args(argc, argv);
+    long n = args.n;
+    long tile = (args.blocksz > 1) ? args.blocksz : OOC_TILE;
+    const char *dir = (optind + 1 < argc) ? argv[optind + 1] : ".";
+    size_t es = elem_size(args.type, false);
+    char path_a[4096], path_t[4096], path_c[4096];
+    OocMatrix A, A_t, C;
+    bool ok = true;
+
+    snprintf(path_a, sizeof(path_a), "%s/ooc_A.cbm", dir);
+    snprintf(path_t, sizeof(path_t), "%s/ooc_A_t.cbm", dir);
+    snprintf(path_c, sizeof(path_c), "%s/ooc_C.cbm", dir);
+
+    printf("\n(creating %ld x %ld %s matrix in %s ...", n, n, elem_name(args.type), dir);
+    fflush(stdout);
+    start = timeInMilliseconds();
+    make_file_matrix(&A, path_a, args.type, n, tile);
+    end = timeInMilliseconds();
+    unsigned long total_create = end - start;
+
+    printf(" performing benchmark ...");
+    fflush(stdout);
+    if (ooc_create(&A_t, path_t, args.type, n, n, tile)) {
+        perror(path_t);
+        exit(1);
+    }
+    start = timeInMilliseconds();
+    if (ooc_transpose(&A, &A_t) || ooc_close(&A_t)) { // the close includes the final write-back
+        perror(path_t);
+        exit(1);
+    }
+    end = timeInMilliseconds();
+    unsigned long total_tr = end - start;
+    printf(" done)\n\n");
+
+    if (ooc_open(&A_t, path_t, false)) {
+        perror(path_t);
+        exit(1);
+    }
+    srand(3410);
+    for (int c = 0; c < OOC_CHECKS; c++) {
+        long i = rand() % n, j = rand() % n;
+        ok = ok && ooc_get(&A, i, j) == ooc_get(&A_t, j, i);
+    }
+
+    printf("Out-of-core, %ld x %ld %s matrices (tile = %ld, %.1f MB on disk each)\n", n, n, elem_name(args.type),
+           tile, A.map_len / 1e6);
+    printf("---------------------------------------------------------\n");
+    printf("  %-14s TIME TO COMPLETION = %lu msec.\n", "create", total_create);
+    print_results_bandwidth("transpose", (int)n, es, total_tr);
+    printf("  transpose spot checks:  %s\n", (ok ? "PASS" : "FAIL"));
+
+    // C = A * A_t, with each spot check recomputed directly from A.  (Past about
+    // n = 400 the sums exceed 2^53, so they are only equal up to rounding.)
+    if (args.type == ELEM_F64 && n <= OOC_MATMULT_MAX) {
+        if (ooc_create(&C, path_c, ELEM_F64, n, n, tile)) {
+            perror(path_c);
+            exit(1);
+        }
+        start = timeInMilliseconds();
+        if (ooc_matmult(&A, &A_t, &C)) {
+            perror(path_c);
+            exit(1);
+        }
+        end = timeInMilliseconds();
+
+        ok = true;
+        for (int c = 0; c < OOC_CHECKS; c++) {
+            long i = rand() % n, j = rand() % n;
+            double sum = 0.0;
+            for (long k = 0; k < n; k++) {
+                sum += ooc_get(&A, i, k) * ooc_get(&A, j, k);
+            }
+            ok = ok && fabs(sum - ooc_get(&C, i, j)) <= 1e-10 * fabs(sum); // summed in another order
+        }
+        printf("  TIME TO COMPLETION (matmult) = %lld msec.  %.2f GFLOP/s\n", end - start,
+               (end > start ? 2.0 * n * n * n / ((end - start) * 1e6) : 0.0));
+        printf("  matmult spot checks:  %s\n", (ok ? "PASS" : "FAIL"));
+        ooc_close(&C);
+        unlink(path_c);
+    }
+    printf("---------------------------------------------------------\n\n");
+
+    ooc_close(&A);
+    ooc_close(&A_t);
+    unlink(path_a);
+    unlink(path_t);
+    return 0;
+} // main
@@ -0,0 +1,109 @@
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "perf.h"
+
+// perf_event_attr type and config of each PerfEvent
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} Events[PERF_EVENTS] = {
+    [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    [PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                         "L1d misses"},
+    [PERF_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses"},
+    [PERF_DTLB_MISSES] = {PERF_TYPE_HW_CACHE,
+                          PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                          "dTLB misses"},
+};
+
+/*
+ * Opens one counter per PerfEvent for the calling thread and the threads it
+ * creates afterwards (so the multithreaded kernels are counted too), in user space
+ * only, which an unprivileged process may do at perf_event_paranoid <= 2.  Each
+ * counter is opened on its own rather than as a group, so that one the CPU lacks
+ * doesn't take the others down with it; a counter that can't be opened is just
+ * left out, and the timing still works with none at all.
+ */
+void perf_open(PerfSession *S) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = Events[e].type;
+        attr.config = Events[e].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        S->fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    S->start_ns = 0;
+} // perf_open
+
+void perf_close(PerfSession *S) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (S->fd[e] >= 0) close(S->fd[e]);
+        S->fd[e] = -1;
+    }
+} // perf_close
+
+/*
+ * Whether any counter at all could be opened.
+ */
+bool perf_available(PerfSession *S) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (S->fd[e] >= 0) return true;
+    }
+    return false;
+} // perf_available
+
+/*
+ * Zeroes and starts the counters, then reads the clock.
+ */
+void perf_start(PerfSession *S) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (S->fd[e] < 0) continue;
+        ioctl(S->fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(S->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    S->start_ns = timeInNanoseconds();
+} // perf_start
+
+/*
+ * Reads the clock, then stops the counters and collects them.  When there were
+ * more events than hardware counters, the kernel time-shares them, and each count
+ * is scaled by enabled / running time to estimate the whole run.
+ */
+PerfSample perf_stop(PerfSession *S) {
+    PerfSample sample;
+
+    sample.ns = timeInNanoseconds() - S->start_ns;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        uint64_t v[3]; // value, time enabled, time running
+
+        sample.count[e] = -1;
+        if (S->fd[e] < 0) continue;
+        ioctl(S->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(S->fd[e], v, sizeof(v)) != sizeof(v) || v[2] == 0) continue;
+        sample.count[e] = (v[2] < v[1]) ? (long long)((double)v[0] * v[1] / v[2]) : (long long)v[0];
+    }
+    return sample;
+} // perf_stop
+
+const char *perf_event_name(PerfEvent e) {
+    return (e >= 0 && e < PERF_EVENTS) ? Events[e].name : "?";
+} // perf_event_name
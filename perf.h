@@ -0,0 +1,39 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+
+// The hardware events counted around each instrumented kernel run
+typedef enum perf_event_t {
+    PERF_CYCLES,       // CPU cycles (user space)
+    PERF_INSTRUCTIONS, // instructions retired (user space)
+    PERF_L1D_MISSES,   // L1 data cache read misses
+    PERF_LLC_MISSES,   // last-level cache misses
+    PERF_DTLB_MISSES,  // data TLB read misses
+    PERF_EVENTS
+} PerfEvent;
+
+/*
+ * One measured run:  the elapsed time, from CLOCK_MONOTONIC_RAW, and the count of
+ * each event, scaled up if the kernel had to multiplex the counter.  A count is -1
+ * when that counter couldn't be opened (no PMU, perf_event_paranoid, a VM, ...).
+ */
+typedef struct perf_sample_t {
+    long long ns;
+    long long count[PERF_EVENTS];
+} PerfSample;
+
+// The open counters of one PerfSession, and the start time of the run in progress
+typedef struct perf_session_t {
+    int fd[PERF_EVENTS]; // -1 where the counter is unavailable
+    long long start_ns;
+} PerfSession;
+
+void perf_open(PerfSession *);
+void perf_close(PerfSession *);
+bool perf_available(PerfSession *);
+void perf_start(PerfSession *);
+PerfSample perf_stop(PerfSession *);
+const char *perf_event_name(PerfEvent);
+
+#endif
@@ -0,0 +1,192 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "placement.h"
+
+// From <numaif.h>, which we don't need libnuma for
+#define MPOL_PREFERRED 1
+
+/*
+ * Off by default.  The -N flag of the drivers, or CACHEBLOCK_NUMA=1 in the
+ * environment, turns it on.
+ */
+bool Numa_Placement = false;
+
+/*
+ * The machine, as read from /sys at startup:  the CPUs this process may run on,
+ * sorted by node (and by number within a node), and the node of each CPU.
+ */
+static int Num_Nodes = 1;
+static int Num_Cpus = 0;
+static int Cpu_Order[CPU_SETSIZE];
+static int Cpu_Node[CPU_SETSIZE];
+static int Node_Id[CPU_SETSIZE]; // sysfs (and mbind) number of each node
+
+/*
+ * Parses a sysfs CPU (or node) list such as "0-3,8-11" into `set`.
+ */
+static void parse_cpulist(const char *list, cpu_set_t *set) {
+    const char *s = list;
+
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+
+        if (end == s) break;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+            CPU_SET(c, set);
+        }
+        s = (*end == ',') ? end + 1 : end;
+        if (*s == '\n') break;
+    }
+} // parse_cpulist
+
+/*
+ * Reads the sysfs file at `path` into buf (of `size` bytes) as a string.  Returns
+ * false if it can't be read.
+ */
+static bool read_sysfs(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+
+    if (!f) return false;
+    size_t len = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    return true;
+} // read_sysfs
+
+__attribute__((constructor)) static void placement_init(void) {
+    cpu_set_t allowed;
+    char *env = getenv("CACHEBLOCK_NUMA");
+
+    if (env && !strcmp(env, "1")) Numa_Placement = true;
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) return;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        Cpu_Node[c] = 0;
+    }
+
+    // Only the nodes that sysfs lists as online, numbered densely here in order
+    char path[64], buf[4096];
+    cpu_set_t online;
+
+    CPU_ZERO(&online);
+    if (read_sysfs("/sys/devices/system/node/online", buf, sizeof(buf))) parse_cpulist(buf, &online);
+
+    int nodes = 0;
+    for (int node = 0; node < CPU_SETSIZE; node++) {
+        if (!CPU_ISSET(node, &online)) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!read_sysfs(path, buf, sizeof(buf))) continue;
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        parse_cpulist(buf, &cpus);
+        CPU_AND(&cpus, &cpus, &allowed);
+        if (!CPU_COUNT(&cpus)) continue; // memory-only, or none of ours
+
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &cpus) && CPU_ISSET(c, &allowed)) {
+                Cpu_Order[Num_Cpus++] = c;
+                Cpu_Node[c] = nodes;
+                CPU_CLR(c, &allowed); // so no CPU is listed twice
+            }
+        }
+        Node_Id[nodes++] = node;
+    }
+    // Anything sysfs didn't account for (or all of it, without sysfs) goes on node 0
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) Cpu_Order[Num_Cpus++] = c;
+    }
+    Num_Nodes = nodes > 1 ? nodes : 1;
+} // placement_init
+
+/*
+ * The number of NUMA nodes with CPUs that this process may use; 1 if the host
+ * isn't NUMA, or we can't tell.
+ */
+int numa_nodes(void) {
+    return Num_Nodes;
+} // numa_nodes
+
+// The CPU for worker `worker` of `nworkers`
+static int worker_cpu(int worker, int nworkers) {
+    return Cpu_Order[(long)worker * Num_Cpus / nworkers];
+}
+
+/*
+ * The node that worker `worker` of `nworkers` is pinned to under Numa_Placement,
+ * or 0 if placement is off or there are more workers than CPUs (and so no
+ * pinning).
+ */
+int numa_worker_node(int worker, int nworkers) {
+    if (!Numa_Placement || nworkers > Num_Cpus) return 0;
+    return Cpu_Node[worker_cpu(worker, nworkers)];
+} // numa_worker_node
+
+/*
+ * The node of the CPU the calling thread is running on.
+ */
+int numa_current_node(void) {
+    int cpu = sched_getcpu();
+    return (cpu >= 0 && cpu < CPU_SETSIZE) ? Cpu_Node[cpu] : 0;
+} // numa_current_node
+
+/*
+ * Pins the calling thread, as worker `worker` of `nworkers`, to its CPU.  If
+ * `saved` isn't NULL, the thread's previous affinity is stored there, for
+ * numa_unpin.  Returns false (and does nothing) if placement is off, or there
+ * are more workers than CPUs.
+ */
+bool numa_pin(int worker, int nworkers, cpu_set_t *saved) {
+    if (!Numa_Placement || nworkers > Num_Cpus) return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker_cpu(worker, nworkers), &set);
+    if (saved) pthread_getaffinity_np(pthread_self(), sizeof(*saved), saved);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+} // numa_pin
+
+/*
+ * Restores the affinity that numa_pin saved.
+ */
+void numa_unpin(cpu_set_t *saved) {
+    pthread_setaffinity_np(pthread_self(), sizeof(*saved), saved);
+} // numa_unpin
+
+/*
+ * Asks the kernel to place the whole pages within [p, p + bytes) on `node`, when
+ * they are first touched (MPOL_PREFERRED, so it falls back to other nodes rather
+ * than fail when that node is full).  A no-op unless placement is on and there
+ * is more than one node.
+ */
+void numa_bind(void *p, size_t bytes, int node) {
+#ifdef SYS_mbind
+    if (!Numa_Placement || Num_Nodes <= 1) return;
+
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)p + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)p + bytes) / page * page;
+    unsigned long mask[CPU_SETSIZE / (8 * sizeof(unsigned long))] = {0};
+
+    int id = Node_Id[node];
+
+    if (end <= start) return;
+    mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, mask, CPU_SETSIZE, 0);
+#else
+    (void)p;
+    (void)bytes;
+    (void)node;
+#endif
+} // numa_bind
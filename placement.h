@@ -0,0 +1,26 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * NUMA-aware placement.  When enabled, the worker threads of run_tiles_static and
+ * run_tiles_ws are pinned to CPUs, node by node (worker i of n gets the i-th of n
+ * evenly spaced CPUs, in node order), so that a contiguous range of workers, and
+ * so a contiguous range of tiles, shares a node.  Work stealing tries victims on
+ * the thief's own node first, and matrix_first_touch binds each page to the node
+ * of the worker that touches it.  Everything degrades to a no-op on single-node
+ * hosts.
+ */
+extern bool Numa_Placement;
+
+int numa_nodes(void);
+int numa_worker_node(int worker, int nworkers);
+int numa_current_node(void);
+bool numa_pin(int worker, int nworkers, cpu_set_t *saved);
+void numa_unpin(cpu_set_t *saved);
+void numa_bind(void *p, size_t bytes, int node);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ *  service.c
+ *  CS3410 (F'24)
+ *
+ *  USAGE:  service  [-b <block_size>] [-t <threads>] [-r <requests>] <matrix_dimension>
+ *
+ *  OVERVIEW:  Tests the asynchronous job API (see jobs.h) under the load of a
+ *     service:  SERVICE_CLIENTS request threads, each issuing -r multiplies
+ *     (default SERVICE_REQUESTS), mostly small ones of the sizes in Small_Sizes,
+ *     with one in SERVICE_LARGE of the given dimension.  Each request is run
+ *     synchronously on its own thread with matmult_bl, and then through
+ *     mm_submit/mm_wait on a pool of -t workers (default: one per CPU).  Reports
+ *     the aggregate throughput, and the median and 99th-percentile latency of the
+ *     small and the large requests.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "helpers.h"
+#include "jobs.h"
+#include "tasks.h"
+#include "threads.h"
+#include "tune.h"
+
+// Request threads, requests per thread (unless -r gives more than one), and the
+// share of large requests (one in this many)
+#define SERVICE_CLIENTS 4
+#define SERVICE_REQUESTS 400
+#define SERVICE_LARGE 50
+
+static const int Small_Sizes[] = {8, 16, 24, 32, 48, 64};
+
+#define SMALL_COUNT ((int)(sizeof(Small_Sizes) / sizeof(Small_Sizes[0])))
+
+// The operands of each size, shared by every client, and their products
+typedef struct operands_t {
+    int n;
+    double *A, *B, *R;
+} Operands;
+
+typedef struct client_t {
+    int id, requests, blocksz;
+    bool async;
+    Operands *ops; // SMALL_COUNT small sizes, then the large one
+    long long *lat_small, *lat_large;
+    int n_small, n_large;
+    bool ok;
+} Client;
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void *client(void *arg) {
+    Client *c = arg;
+    double *Cs[SMALL_COUNT + 1];
+
+    for (int s = 0; s <= SMALL_COUNT; s++) {
+        Cs[s] = make_one_matrix(c->ops[s].n);
+    }
+    c->ok = true;
+    c->n_small = c->n_large = 0;
+
+    for (int q = 0; q < c->requests; q++) {
+        int s = ((q + c->id) % SERVICE_LARGE == 0) ? SMALL_COUNT : (q * 7 + c->id) % SMALL_COUNT;
+        Operands *o = &c->ops[s];
+        long long start = timeInNanoseconds();
+
+        if (c->async) {
+            MmJob job = {.op = MM_MATMULT, .n = o->n, .blocksz = c->blocksz, .A = o->A, .B = o->B, .C = Cs[s]};
+            mm_wait(mm_submit(job));
+        } else {
+            zero(o->n, Cs[s]);
+            matmult_bl(o->n, c->blocksz, o->A, o->B, Cs[s]);
+        }
+
+        long long lat = timeInNanoseconds() - start;
+        if (s == SMALL_COUNT) {
+            c->lat_large[c->n_large++] = lat;
+        } else {
+            c->lat_small[c->n_small++] = lat;
+        }
+        c->ok = c->ok && max_abs_diff(o->n, o->R, Cs[s]) == 0.0;
+    }
+
+    for (int s = 0; s <= SMALL_COUNT; s++) {
+        matrix_free(Cs[s]);
+    }
+    return NULL;
+} // client
+
+/*
+ * Prints the median and 99th percentile of the `count` latencies in lat[]
+ * (sorting them).
+ */
+static void print_latency(const char *label, long long *lat, int count) {
+    if (!count) return;
+
+    qsort(lat, count, sizeof(long long), cmp_ll);
+    printf("  %-6s requests:  %5d   median = %9.3f ms   p99 = %9.3f ms\n", label, count, lat[count / 2] / 1e6,
+           lat[(long)count * 99 / 100 < count ? (long)count * 99 / 100 : count - 1] / 1e6);
+}
+
+int main(int argc, char **argv) {
+    Args args = get_args(argc, argv);
+    int requests = (args.reps > 1) ? args.reps : SERVICE_REQUESTS;
+    Operands ops[SMALL_COUNT + 1];
+    Client clients[SERVICE_CLIENTS];
+    pthread_t tids[SERVICE_CLIENTS];
+    long long *lat_small = malloc(SERVICE_CLIENTS * requests * sizeof(long long));
+    long long *lat_large = malloc(SERVICE_CLIENTS * requests * sizeof(long long));
+
+    // Resolve the default block size here, so the report shows the one in use
+    if (args.blocksz <= 0) args.blocksz = tune_block(TUNE_MATMULT_BL, args.n);
+
+    for (int s = 0; s <= SMALL_COUNT; s++) {
+        int n = (s < SMALL_COUNT) ? Small_Sizes[s] : args.n;
+
+        ops[s] = (Operands){.n = n, .A = make_one_matrix(n), .B = make_one_matrix(n), .R = make_one_matrix(n)};
+        zero(n, ops[s].R);
+        matmult_bl(n, args.blocksz, ops[s].A, ops[s].B, ops[s].R);
+    }
+    mm_pool_start(args.threads);
+
+    for (int mode = 0; mode < 2; mode++) {
+        int n_small = 0, n_large = 0;
+        bool ok = true;
+        double flops = 0.0;
+
+        long long start = timeInNanoseconds();
+        for (int i = 0; i < SERVICE_CLIENTS; i++) {
+            clients[i] = (Client){
+                .id = i, .requests = requests, .blocksz = args.blocksz, .async = mode == 1, .ops = ops,
+                .lat_small = lat_small + i * requests, .lat_large = lat_large + i * requests,
+            };
+            pthread_create(&tids[i], NULL, client, &clients[i]);
+        }
+        for (int i = 0; i < SERVICE_CLIENTS; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        long long total = timeInNanoseconds() - start;
+
+        // Gather each client's latencies at the front of the arrays
+        for (int i = 0; i < SERVICE_CLIENTS; i++) {
+            memmove(lat_small + n_small, clients[i].lat_small, clients[i].n_small * sizeof(long long));
+            memmove(lat_large + n_large, clients[i].lat_large, clients[i].n_large * sizeof(long long));
+            n_small += clients[i].n_small;
+            n_large += clients[i].n_large;
+            ok = ok && clients[i].ok;
+            for (int q = 0; q < requests; q++) {
+                int s = ((q + i) % SERVICE_LARGE == 0) ? SMALL_COUNT : (q * 7 + i) % SMALL_COUNT;
+                flops += 2.0 * ops[s].n * ops[s].n * ops[s].n;
+            }
+        }
+
+        if (mode == 0) {
+            printf("Synchronous matmult_bl on %d request threads (block size = %d, large n = %d)\n",
+                   SERVICE_CLIENTS, args.blocksz, args.n);
+        } else {
+            printf("mm_submit/mm_wait from %d request threads, %d workers\n", SERVICE_CLIENTS, mm_pool_threads());
+        }
+        printf("---------------------------------------------------------\n");
+        printf("  TIME TO COMPLETION = %.1f msec.   %.0f requests/s   %.2f GFLOP/s   %s\n", total / 1e6,
+               SERVICE_CLIENTS * requests / (total / 1e9), flops / total, (ok ? "PASS" : "FAIL"));
+        print_latency("small", lat_small, n_small);
+        print_latency("large", lat_large, n_large);
+        printf("---------------------------------------------------------\n\n");
+    }
+
+    mm_pool_stop();
+    for (int s = 0; s <= SMALL_COUNT; s++) {
+        matrix_free(ops[s].A);
+        matrix_free(ops[s].B);
+        matrix_free(ops[s].R);
+    }
+    free(lat_small);
+    free(lat_large);
+    return 0;
+} // main
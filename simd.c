@@ -0,0 +1,293 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * The scalar fallback.  These are the original loops from tasks.c, left to the
+ * compiler's auto-vectorizer.
+ */
+static void axpy_scalar(int len, double a, double *x, double *y) {
+    for (int j = 0; j < len; j++) {
+        y[j] += a * x[j];
+    }
+}
+
+static void micro_scalar(int kc, double *A, int lda, double *B, int ldb, double c[MM_MR][MM_NR]) {
+    double acc[MM_MR][MM_NR] = {{0.0}}; // local, so that it can live in registers
+
+    for (int k = 0; k < kc; k++) {
+        double *b = B + k * ldb;
+        for (int i = 0; i < MM_MR; i++) {
+            double a = A[i * lda + k];
+            for (int j = 0; j < MM_NR; j++) {
+                acc[i][j] += a * b[j];
+            }
+        }
+    }
+    memcpy(c, acc, sizeof(acc));
+}
+
+static void micro_packed_scalar(int kc, double *Ap, double *Bp, double c[MM_MR][MM_NR]) {
+    double acc[MM_MR][MM_NR] = {{0.0}};
+
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < MM_MR; i++) {
+            for (int j = 0; j < MM_NR; j++) {
+                acc[i][j] += Ap[i] * Bp[j];
+            }
+        }
+        Ap += MM_MR;
+        Bp += MM_NR;
+    }
+    memcpy(c, acc, sizeof(acc));
+}
+
+// Every n that matmult_batched has its own unrolled kernel for, 1 to BATCH_MAX.
+#define BATCH_SIZES(X)                                                                                       \
+    X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) \
+        X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32)
+
+/*
+ * C = A * B for one N x N matrix, for the scalar batch_scalar_<N> kernels; as for
+ * the vector ones in simd_kernels.h, a constant N unrolls everything.
+ */
+static inline __attribute__((always_inline)) void batch_mm_scalar(int N, double *restrict A, double *restrict B,
+                                                                  double *restrict C) {
+    for (int i = 0; i < N; i++) {
+        double c[BATCH_MAX] = {0.0};
+
+        for (int k = 0; k < N; k++) {
+            for (int j = 0; j < N; j++) {
+                c[j] += A[i * N + k] * B[k * N + j];
+            }
+        }
+        memcpy(C + i * N, c, N * sizeof(double));
+    }
+}
+
+#define BATCH_SCALAR_DEF(N)                                                                                  \
+    static void batch_scalar_##N(double *A, double *B, double *C) { batch_mm_scalar(N, A, B, C); }
+#define BATCH_SCALAR_ENTRY(N) [N] = batch_scalar_##N,
+
+BATCH_SIZES(BATCH_SCALAR_DEF)
+
+static const BatchFn batch_scalar[BATCH_MAX + 1] = {BATCH_SIZES(BATCH_SCALAR_ENTRY)};
+
+#if SIMD_X86
+/////////////////////////////////////////////////////////////////////////
+// SSE2:  2 doubles per vector, no FMA.
+#define SIMD_SUFFIX sse2
+#define SIMD_TARGET __attribute__((target("sse2")))
+#define VEC __m128d
+#define VW 2
+#define VLOAD _mm_loadu_pd
+#define VSTORE _mm_storeu_pd
+#define VSET1 _mm_set1_pd
+#define VZERO _mm_setzero_pd()
+#define VFMA(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+
+/*
+ * dst[0:2][0:2] = transpose(src[0:2][0:2]), each with its own row stride.
+ */
+__attribute__((target("sse2"))) static inline void tr_micro_sse2(double *src, int lds, double *dst, int ldd) {
+    __m128d r0 = _mm_loadu_pd(src), r1 = _mm_loadu_pd(src + lds);
+
+    _mm_storeu_pd(dst, _mm_unpacklo_pd(r0, r1));       // [a0 b0]
+    _mm_storeu_pd(dst + ldd, _mm_unpackhi_pd(r0, r1)); // [a1 b1]
+}
+
+#include "simd_kernels.h"
+#undef SIMD_SUFFIX
+#undef SIMD_TARGET
+#undef VEC
+#undef VW
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VZERO
+#undef VFMA
+
+/////////////////////////////////////////////////////////////////////////
+// AVX2 + FMA:  4 doubles per vector.
+#define SIMD_SUFFIX avx2
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+#define VEC __m256d
+#define VW 4
+#define VLOAD _mm256_loadu_pd
+#define VSTORE _mm256_storeu_pd
+#define VSET1 _mm256_set1_pd
+#define VZERO _mm256_setzero_pd()
+#define VFMA _mm256_fmadd_pd
+
+/*
+ * dst[0:4][0:4] = transpose(src[0:4][0:4]):  interleave pairs of rows within each
+ * 128-bit lane, then swap the lanes across.
+ */
+__attribute__((target("avx2"))) static inline void tr_micro_avx2(double *src, int lds, double *dst, int ldd) {
+    __m256d r0 = _mm256_loadu_pd(src), r1 = _mm256_loadu_pd(src + lds);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * lds), r3 = _mm256_loadu_pd(src + 3 * lds);
+
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1); // [a0 b0 a2 b2]
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1); // [a1 b1 a3 b3]
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3); // [c0 d0 c2 d2]
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3); // [c1 d1 c3 d3]
+
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));           // [a0 b0 c0 d0]
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));     // [a1 b1 c1 d1]
+    _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31)); // [a2 b2 c2 d2]
+    _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31)); // [a3 b3 c3 d3]
+}
+
+#include "simd_kernels.h"
+#undef SIMD_SUFFIX
+#undef SIMD_TARGET
+#undef VEC
+#undef VW
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VZERO
+#undef VFMA
+
+/////////////////////////////////////////////////////////////////////////
+// AVX-512F:  8 doubles per vector, with FMA.
+#define SIMD_SUFFIX avx512
+#define SIMD_TARGET __attribute__((target("avx512f")))
+#define VEC __m512d
+#define VW 8
+#define VLOAD _mm512_loadu_pd
+#define VSTORE _mm512_storeu_pd
+#define VSET1 _mm512_set1_pd
+#define VZERO _mm512_setzero_pd()
+#define VFMA _mm512_fmadd_pd
+
+/*
+ * dst[0:8][0:8] = transpose(src[0:8][0:8]):  interleave pairs of rows within each
+ * 128-bit lane, then gather even and odd lanes twice over, so that each lane of a
+ * result holds one pair (a..h) of the output column.
+ */
+__attribute__((target("avx512f"))) static inline void tr_micro_avx512(double *src, int lds, double *dst,
+                                                                      int ldd) {
+    __m512d r[8], t[8], u[8];
+
+    for (int k = 0; k < 8; k++) {
+        r[k] = _mm512_loadu_pd(src + k * lds);
+    }
+    for (int k = 0; k < 8; k += 2) {
+        t[k] = _mm512_unpacklo_pd(r[k], r[k + 1]);     // t0 = [a0 b0 | a2 b2 | a4 b4 | a6 b6]
+        t[k + 1] = _mm512_unpackhi_pd(r[k], r[k + 1]); // t1 = [a1 b1 | a3 b3 | a5 b5 | a7 b7]
+    }
+    for (int k = 0; k < 8; k += 4) {
+        u[k] = _mm512_shuffle_f64x2(t[k], t[k + 2], 0x88);         // u0 = [a0 b0 | a4 b4 | c0 d0 | c4 d4]
+        u[k + 1] = _mm512_shuffle_f64x2(t[k], t[k + 2], 0xdd);     // u1 = [a2 b2 | a6 b6 | c2 d2 | c6 d6]
+        u[k + 2] = _mm512_shuffle_f64x2(t[k + 1], t[k + 3], 0x88); // u2 = [a1 b1 | a5 b5 | c1 d1 | c5 d5]
+        u[k + 3] = _mm512_shuffle_f64x2(t[k + 1], t[k + 3], 0xdd); // u3 = [a3 b3 | a7 b7 | c3 d3 | c7 d7]
+    }
+
+    _mm512_storeu_pd(dst, _mm512_shuffle_f64x2(u[0], u[4], 0x88));           // [a0 b0 c0 d0 e0 .. h0]
+    _mm512_storeu_pd(dst + 4 * ldd, _mm512_shuffle_f64x2(u[0], u[4], 0xdd)); // [a4 .. h4]
+    _mm512_storeu_pd(dst + 2 * ldd, _mm512_shuffle_f64x2(u[1], u[5], 0x88));
+    _mm512_storeu_pd(dst + 6 * ldd, _mm512_shuffle_f64x2(u[1], u[5], 0xdd));
+    _mm512_storeu_pd(dst + 1 * ldd, _mm512_shuffle_f64x2(u[2], u[6], 0x88));
+    _mm512_storeu_pd(dst + 5 * ldd, _mm512_shuffle_f64x2(u[2], u[6], 0xdd));
+    _mm512_storeu_pd(dst + 3 * ldd, _mm512_shuffle_f64x2(u[3], u[7], 0x88));
+    _mm512_storeu_pd(dst + 7 * ldd, _mm512_shuffle_f64x2(u[3], u[7], 0xdd));
+}
+
+#include "simd_kernels.h"
+#undef SIMD_SUFFIX
+#undef SIMD_TARGET
+#undef VEC
+#undef VW
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VZERO
+#undef VFMA
+#endif // SIMD_X86
+
+/////////////////////////////////////////////////////////////////////////
+static const SimdKernels Kernels[SIMD_LEVELS] = {
+    [SIMD_SCALAR] = {SIMD_SCALAR, "scalar", axpy_scalar, NULL, NULL, micro_scalar, micro_packed_scalar, NULL,
+                     NULL, NULL, batch_scalar},
+#if SIMD_X86
+    [SIMD_SSE2] = {SIMD_SSE2, "sse2", axpy_sse2, bl_tile_sse2, bl_fixed_sse2, micro_sse2, micro_packed_sse2,
+                   tr_tile_sse2, tr_fixed_sse2, tr_swap_sse2, batch_sse2},
+    [SIMD_AVX2] = {SIMD_AVX2, "avx2", axpy_avx2, bl_tile_avx2, bl_fixed_avx2, micro_avx2, micro_packed_avx2,
+                   tr_tile_avx2, tr_fixed_avx2, tr_swap_avx2, batch_avx2},
+    [SIMD_AVX512] = {SIMD_AVX512, "avx512", axpy_avx512, bl_tile_avx512, bl_fixed_avx512, micro_avx512,
+                     micro_packed_avx512, tr_tile_avx512, tr_fixed_avx512, tr_swap_avx512, batch_avx512},
+#endif
+};
+
+/*
+ * The kernels in use.  Starts out scalar, so it is valid even before simd_init
+ * has run, and is upgraded to the best level the CPU supports at startup.
+ */
+SimdKernels Simd = {SIMD_SCALAR, "scalar", axpy_scalar, NULL, NULL, micro_scalar, micro_packed_scalar, NULL,
+                    NULL, NULL, batch_scalar};
+
+/*
+ * Returns true if and only if this build has kernels for `level`, and the CPU
+ * we're running on can execute them.
+ */
+bool simd_supported(SimdLevel level) {
+    switch (level) {
+    case SIMD_SCALAR:
+        return true;
+#if SIMD_X86
+    case SIMD_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SIMD_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SIMD_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+} // simd_supported
+
+/*
+ * Switches every kernel to the `level` variant.  Returns false (and changes
+ * nothing) if that level isn't supported here.  Not thread-safe:  call it
+ * between multiplies, not during one.
+ */
+bool simd_select(SimdLevel level) {
+    if (!simd_supported(level)) return false;
+
+    Simd = Kernels[level];
+    return true;
+} // simd_select
+
+const char *simd_name(SimdLevel level) {
+    static const char *names[SIMD_LEVELS] = {"scalar", "sse2", "avx2", "avx512"};
+    return (level >= 0 && level < SIMD_LEVELS) ? names[level] : "?";
+} // simd_name
+
+/*
+ * Runs once at program startup and picks the widest supported level.  The
+ * CACHEBLOCK_SIMD environment variable (scalar, sse2, avx2 or avx512) caps the
+ * level, e.g. to benchmark the narrower kernels on a wide machine.
+ */
+__attribute__((constructor)) static void simd_init(void) {
+    SimdLevel cap = SIMD_LEVELS - 1;
+    char *env = getenv("CACHEBLOCK_SIMD");
+
+    for (int l = 0; env && l < SIMD_LEVELS; l++) {
+        if (!strcmp(env, simd_name(l))) cap = l;
+    }
+    for (int l = cap; l >= SIMD_SCALAR; l--) {
+        if (simd_select(l)) return;
+    }
+} // simd_init
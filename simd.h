@@ -0,0 +1,75 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+
+#include "tasks.h"
+
+// Instruction-set levels, in increasing order of capability.
+typedef enum simd_level_t {
+    SIMD_SCALAR, // plain C; whatever the compiler makes of it
+    SIMD_SSE2,   // 2 doubles per vector (the x86-64 baseline)
+    SIMD_AVX2,   // 4 doubles per vector, with FMA
+    SIMD_AVX512, // 8 doubles per vector, with FMA
+    SIMD_LEVELS
+} SimdLevel;
+
+// C = A * B for one n x n matrix, n fixed in the kernel (see matmult_batched)
+typedef void (*BatchFn)(double *A, double *B, double *C);
+
+// The block sizes that matmult_bl and transpose_bl have constant-bound tile kernels for
+#define FIXED_BLOCK_SIZES(X) X(8) X(16) X(32) X(64)
+#define FIXED_BLOCK_MAX 64
+
+// bl_tile and tr_tile for one full bs x bs tile, bs fixed in the kernel
+typedef void (*BlFixedFn)(int n, double *A, double *B, double *C, int i0, int j0, int k0);
+typedef void (*TrFixedFn)(int n, double *M, double *M_t, int i0, int j0);
+
+/*
+ * The hand-vectorized inner kernels for one SimdLevel.  Every matrix argument is
+ * row-major with leading dimension n (or lda/ldb), as in tasks.c.
+ */
+typedef struct simd_kernels_t {
+    SimdLevel level;
+    const char *name;
+
+    // y[0:len] += a * x[0:len]
+    void (*axpy)(int len, double a, double *x, double *y);
+
+    // C[i0:i0+ilen][j0:j0+jlen] += A[i0:..][k0:k0+klen] * B[k0:..][j0:..];  NULL
+    // at SIMD_SCALAR, where matmult_bl's own constant-bound loops are the fallback
+    void (*bl_tile)(int n, double *A, double *B, double *C, int i0, int j0, int k0, int ilen, int jlen,
+                    int klen);
+
+    // bl_fixed[bs] for each bs in FIXED_BLOCK_SIZES, NULL for any other bs;  the
+    // table is NULL at SIMD_SCALAR
+    const BlFixedFn *bl_fixed;
+
+    // c = A[0:MM_MR][0:kc] * B[0:kc][0:MM_NR], with A and B read in place
+    void (*micro)(int kc, double *A, int lda, double *B, int ldb, double c[MM_MR][MM_NR]);
+
+    // c = Ap * Bp, for the packed slivers built by matmult_packed
+    void (*micro_packed)(int kc, double *Ap, double *Bp, double c[MM_MR][MM_NR]);
+
+    // M_t[j][i] = M[i][j] for the ilen x jlen tile at M[i0][j0], built from in-register
+    // transposes of vector-width squares;  NULL at SIMD_SCALAR
+    void (*tr_tile)(int n, double *M, double *M_t, int i0, int j0, int ilen, int jlen);
+
+    // tr_fixed[bs], as for bl_fixed
+    const TrFixedFn *tr_fixed;
+
+    // In place:  swaps the ilen x jlen tile at M[i0][j0] with the transpose of the
+    // (disjoint) jlen x ilen tile at M[j0][i0];  NULL at SIMD_SCALAR
+    void (*tr_swap)(int n, double *M, int i0, int j0, int ilen, int jlen);
+
+    // batch[n] for 1 <= n <= BATCH_MAX;  batch[0] is NULL
+    const BatchFn *batch;
+} SimdKernels;
+
+extern SimdKernels Simd;
+
+bool simd_supported(SimdLevel);
+bool simd_select(SimdLevel);
+const char *simd_name(SimdLevel);
+
+#endif
@@ -0,0 +1,337 @@
+/*
+ * The vectorized kernels of simd.c, written once against a small vector "ISA" and
+ * included by simd.c once per instruction set.  (So, deliberately, there is no
+ * include guard.)  Before each inclusion, simd.c defines:
+ *
+ *   SIMD_SUFFIX      suffix for the generated function names (sse2, avx2, ...)
+ *   SIMD_TARGET      function attribute enabling that instruction set
+ *   VEC              the vector type, holding VW doubles
+ *   VLOAD, VSTORE    unaligned load/store of VW doubles
+ *   VSET1            broadcast a double
+ *   VZERO            a zero vector
+ *   VFMA(a, b, c)    a * b + c
+ *
+ * and #undefs them again afterwards.  It must also define tr_micro_<suffix>, which
+ * transposes one VW x VW square in registers (see tr_tile), and BATCH_SIZES(X),
+ * which applies X to each of 1, 2, ..., BATCH_MAX.
+ */
+
+#define SIMD_CAT_(name, suffix) name##_##suffix
+#define SIMD_CAT(name, suffix) SIMD_CAT_(name, suffix)
+#define SIMD_FN(name) SIMD_CAT(name, SIMD_SUFFIX)
+
+SIMD_TARGET static void SIMD_FN(axpy)(int len, double a, double *x, double *y) {
+    VEC va = VSET1(a);
+    int j = 0;
+
+    for (; j + VW <= len; j += VW) {
+        VSTORE(y + j, VFMA(va, VLOAD(x + j), VLOAD(y + j)));
+    }
+    for (; j < len; j++) {
+        y[j] += a * x[j];
+    }
+}
+
+/*
+ * One tile of matmult_bl.  C is updated 4 rows x (2 * VW) columns at a time:
+ * those 8 vectors stay in registers for the whole k loop, so each step costs
+ * two loads of B, four broadcasts of A, and eight fused multiply-adds along j.
+ * Leftover columns take one vector across the same 4 rows, then scalars;
+ * leftover rows are finished one at a time, in single vectors, then scalars.
+ * Always inlined, into bl_tile and into each bl_fixed kernel with constant extents.
+ */
+SIMD_TARGET static inline __attribute__((always_inline)) void SIMD_FN(bl_kernel)(int n, double *A, double *B,
+                                                                                  double *C, int i0, int j0,
+                                                                                  int k0, int ilen, int jlen,
+                                                                                  int klen) {
+    int i_end = i0 + ilen, j_end = j0 + jlen, k_end = k0 + klen;
+    int i = i0;
+
+    for (; i + 4 <= i_end; i += 4) {
+        int j = j0;
+
+        for (; j + 2 * VW <= j_end; j += 2 * VW) {
+            VEC c[4][2];
+            for (int r = 0; r < 4; r++) {
+                c[r][0] = VLOAD(C + (i + r) * n + j);
+                c[r][1] = VLOAD(C + (i + r) * n + j + VW);
+            }
+            for (int k = k0; k < k_end; k++) {
+                VEC b0 = VLOAD(B + k * n + j), b1 = VLOAD(B + k * n + j + VW);
+                for (int r = 0; r < 4; r++) {
+                    VEC a = VSET1(A[(i + r) * n + k]);
+                    c[r][0] = VFMA(a, b0, c[r][0]);
+                    c[r][1] = VFMA(a, b1, c[r][1]);
+                }
+            }
+            for (int r = 0; r < 4; r++) {
+                VSTORE(C + (i + r) * n + j, c[r][0]);
+                VSTORE(C + (i + r) * n + j + VW, c[r][1]);
+            }
+        }
+        for (; j + VW <= j_end; j += VW) {
+            VEC c[4];
+            for (int r = 0; r < 4; r++) {
+                c[r] = VLOAD(C + (i + r) * n + j);
+            }
+            for (int k = k0; k < k_end; k++) {
+                VEC b0 = VLOAD(B + k * n + j);
+                for (int r = 0; r < 4; r++) {
+                    c[r] = VFMA(VSET1(A[(i + r) * n + k]), b0, c[r]);
+                }
+            }
+            for (int r = 0; r < 4; r++) {
+                VSTORE(C + (i + r) * n + j, c[r]);
+            }
+        }
+        for (int r = 0; r < 4; r++) {
+            for (int jt = j; jt < j_end; jt++) {
+                double sum = C[(i + r) * n + jt];
+                for (int k = k0; k < k_end; k++) {
+                    sum += A[(i + r) * n + k] * B[k * n + jt];
+                }
+                C[(i + r) * n + jt] = sum;
+            }
+        }
+    }
+
+    for (; i < i_end; i++) {
+        int j = j0;
+
+        for (; j + VW <= j_end; j += VW) {
+            VEC c = VLOAD(C + i * n + j);
+            for (int k = k0; k < k_end; k++) {
+                c = VFMA(VSET1(A[i * n + k]), VLOAD(B + k * n + j), c);
+            }
+            VSTORE(C + i * n + j, c);
+        }
+        for (; j < j_end; j++) {
+            double sum = C[i * n + j];
+            for (int k = k0; k < k_end; k++) {
+                sum += A[i * n + k] * B[k * n + j];
+            }
+            C[i * n + j] = sum;
+        }
+    }
+}
+
+SIMD_TARGET static void SIMD_FN(bl_tile)(int n, double *A, double *B, double *C, int i0, int j0, int k0,
+                                         int ilen, int jlen, int klen) {
+    SIMD_FN(bl_kernel)(n, A, B, C, i0, j0, k0, ilen, jlen, klen);
+}
+
+SIMD_TARGET static void SIMD_FN(micro)(int kc, double *A, int lda, double *B, int ldb,
+                                       double c[MM_MR][MM_NR]) {
+    VEC acc[MM_MR][MM_NR / VW];
+
+    for (int i = 0; i < MM_MR; i++) {
+        for (int v = 0; v < MM_NR / VW; v++) {
+            acc[i][v] = VZERO;
+        }
+    }
+    for (int k = 0; k < kc; k++) {
+        VEC b[MM_NR / VW];
+        for (int v = 0; v < MM_NR / VW; v++) {
+            b[v] = VLOAD(B + k * ldb + v * VW);
+        }
+        for (int i = 0; i < MM_MR; i++) {
+            VEC a = VSET1(A[i * lda + k]);
+            for (int v = 0; v < MM_NR / VW; v++) {
+                acc[i][v] = VFMA(a, b[v], acc[i][v]);
+            }
+        }
+    }
+    for (int i = 0; i < MM_MR; i++) {
+        for (int v = 0; v < MM_NR / VW; v++) {
+            VSTORE(&c[i][v * VW], acc[i][v]);
+        }
+    }
+}
+
+SIMD_TARGET static void SIMD_FN(micro_packed)(int kc, double *Ap, double *Bp, double c[MM_MR][MM_NR]) {
+    VEC acc[MM_MR][MM_NR / VW];
+
+    for (int i = 0; i < MM_MR; i++) {
+        for (int v = 0; v < MM_NR / VW; v++) {
+            acc[i][v] = VZERO;
+        }
+    }
+    for (int k = 0; k < kc; k++) {
+        VEC b[MM_NR / VW];
+        for (int v = 0; v < MM_NR / VW; v++) {
+            b[v] = VLOAD(Bp + v * VW);
+        }
+        for (int i = 0; i < MM_MR; i++) {
+            VEC a = VSET1(Ap[i]);
+            for (int v = 0; v < MM_NR / VW; v++) {
+                acc[i][v] = VFMA(a, b[v], acc[i][v]);
+            }
+        }
+        Ap += MM_MR;
+        Bp += MM_NR;
+    }
+    for (int i = 0; i < MM_MR; i++) {
+        for (int v = 0; v < MM_NR / VW; v++) {
+            VSTORE(&c[i][v * VW], acc[i][v]);
+        }
+    }
+}
+
+/*
+ * One tile of a transpose:  M_t[j][i] = M[i][j] for the ilen x jlen tile at M[i0][j0].
+ * The tile is cut into VW x VW squares, and each square is loaded as VW row vectors,
+ * transposed in registers by tr_micro, and stored as VW column vectors, so every
+ * load and store moves a whole vector.  The ragged right and bottom edges are
+ * copied one element at a time.  Always inlined, as bl_kernel is.
+ */
+SIMD_TARGET static inline __attribute__((always_inline)) void SIMD_FN(tr_kernel)(int n, double *M, double *M_t,
+                                                                                  int i0, int j0, int ilen,
+                                                                                  int jlen) {
+    int i_end = i0 + ilen, j_end = j0 + jlen;
+    int i = i0;
+
+    for (; i + VW <= i_end; i += VW) {
+        int j = j0;
+
+        for (; j + VW <= j_end; j += VW) {
+            SIMD_FN(tr_micro)(M + i * n + j, n, M_t + j * n + i, n);
+        }
+        for (; j < j_end; j++) {
+            for (int r = 0; r < VW; r++) {
+                M_t[j * n + i + r] = M[(i + r) * n + j];
+            }
+        }
+    }
+    for (; i < i_end; i++) {
+        for (int j = j0; j < j_end; j++) {
+            M_t[j * n + i] = M[i * n + j];
+        }
+    }
+}
+
+SIMD_TARGET static void SIMD_FN(tr_tile)(int n, double *M, double *M_t, int i0, int j0, int ilen, int jlen) {
+    SIMD_FN(tr_kernel)(n, M, M_t, i0, j0, ilen, jlen);
+}
+
+/*
+ * bl_kernel and tr_kernel for one full BS x BS tile, once for each size in
+ * FIXED_BLOCK_SIZES, so that every extent is a constant.
+ */
+#define SIMD_FIXED_FN(name, BS) SIMD_CAT(SIMD_FN(name), BS)
+#define SIMD_FIXED_DEF(BS)                                                                                   \
+    SIMD_TARGET static void SIMD_FIXED_FN(bl_fixed, BS)(int n, double *A, double *B, double *C, int i0, int j0, \
+                                                        int k0) {                                              \
+        SIMD_FN(bl_kernel)(n, A, B, C, i0, j0, k0, BS, BS, BS);                                                \
+    }                                                                                                          \
+    SIMD_TARGET static void SIMD_FIXED_FN(tr_fixed, BS)(int n, double *M, double *M_t, int i0, int j0) {       \
+        SIMD_FN(tr_kernel)(n, M, M_t, i0, j0, BS, BS);                                                         \
+    }
+#define SIMD_BL_FIXED_ENTRY(BS) [BS] = SIMD_FIXED_FN(bl_fixed, BS),
+#define SIMD_TR_FIXED_ENTRY(BS) [BS] = SIMD_FIXED_FN(tr_fixed, BS),
+
+FIXED_BLOCK_SIZES(SIMD_FIXED_DEF)
+
+static const BlFixedFn SIMD_FN(bl_fixed)[FIXED_BLOCK_MAX + 1] = {FIXED_BLOCK_SIZES(SIMD_BL_FIXED_ENTRY)};
+static const TrFixedFn SIMD_FN(tr_fixed)[FIXED_BLOCK_MAX + 1] = {FIXED_BLOCK_SIZES(SIMD_TR_FIXED_ENTRY)};
+
+#undef SIMD_TR_FIXED_ENTRY
+#undef SIMD_BL_FIXED_ENTRY
+#undef SIMD_FIXED_DEF
+#undef SIMD_FIXED_FN
+
+/*
+ * The in-place counterpart of tr_tile:  swaps the ilen x jlen tile at M[i0][j0] with
+ * the transpose of the jlen x ilen tile at M[j0][i0], which must not overlap it.
+ * Each pair of VW x VW squares is exchanged through a VW x VW buffer on the stack:
+ * the first square is saved, the second is transposed over it, and the saved copy
+ * is transposed into the second's place.
+ */
+SIMD_TARGET static void SIMD_FN(tr_swap)(int n, double *M, int i0, int j0, int ilen, int jlen) {
+    int i_end = i0 + ilen, j_end = j0 + jlen;
+    double tmp[VW * VW];
+    double t;
+    int i = i0;
+
+    for (; i + VW <= i_end; i += VW) {
+        int j = j0;
+
+        for (; j + VW <= j_end; j += VW) {
+            for (int r = 0; r < VW; r++) {
+                VSTORE(tmp + r * VW, VLOAD(M + (i + r) * n + j));
+            }
+            SIMD_FN(tr_micro)(M + j * n + i, n, M + i * n + j, n);
+            SIMD_FN(tr_micro)(tmp, VW, M + j * n + i, n);
+        }
+        for (; j < j_end; j++) {
+            for (int r = 0; r < VW; r++) {
+                t = M[(i + r) * n + j];
+                M[(i + r) * n + j] = M[j * n + i + r];
+                M[j * n + i + r] = t;
+            }
+        }
+    }
+    for (; i < i_end; i++) {
+        for (int j = j0; j < j_end; j++) {
+            t = M[i * n + j];
+            M[i * n + j] = M[j * n + i];
+            M[j * n + i] = t;
+        }
+    }
+}
+
+/*
+ * C = A * B for one N x N matrix, overwriting C.  Every batch_<suffix>_<N> below
+ * inlines this with a constant N, so all the loops unroll completely.  Each row of
+ * C is built in registers:  N / VW vectors, plus the N % VW leftover columns as
+ * scalars, accumulate A[i][k] * B[k][:] over k and are then stored once.
+ */
+SIMD_TARGET static inline __attribute__((always_inline)) void SIMD_FN(batch_mm)(int N, double *restrict A,
+                                                                                 double *restrict B,
+                                                                                 double *restrict C) {
+    int nv = N / VW, j0 = nv * VW;
+
+    for (int i = 0; i < N; i++) {
+        VEC c[BATCH_MAX / VW];
+        double t[VW];
+
+        for (int v = 0; v < nv; v++) {
+            c[v] = VZERO;
+        }
+        for (int j = j0; j < N; j++) {
+            t[j - j0] = 0.0;
+        }
+        for (int k = 0; k < N; k++) {
+            VEC a = VSET1(A[i * N + k]);
+            for (int v = 0; v < nv; v++) {
+                c[v] = VFMA(a, VLOAD(B + k * N + v * VW), c[v]);
+            }
+            for (int j = j0; j < N; j++) {
+                t[j - j0] += A[i * N + k] * B[k * N + j];
+            }
+        }
+        for (int v = 0; v < nv; v++) {
+            VSTORE(C + i * N + v * VW, c[v]);
+        }
+        for (int j = j0; j < N; j++) {
+            C[i * N + j] = t[j - j0];
+        }
+    }
+}
+
+#define SIMD_BATCH_FN(N) SIMD_CAT(SIMD_FN(batch), N)
+#define SIMD_BATCH_DEF(N)                                                                                    \
+    SIMD_TARGET static void SIMD_BATCH_FN(N)(double *A, double *B, double *C) {                                \
+        SIMD_FN(batch_mm)(N, A, B, C);                                                                         \
+    }
+#define SIMD_BATCH_ENTRY(N) [N] = SIMD_BATCH_FN(N),
+
+BATCH_SIZES(SIMD_BATCH_DEF)
+
+static const BatchFn SIMD_FN(batch)[BATCH_MAX + 1] = {BATCH_SIZES(SIMD_BATCH_ENTRY)};
+
+#undef SIMD_BATCH_ENTRY
+#undef SIMD_BATCH_DEF
+#undef SIMD_BATCH_FN
+#undef SIMD_FN
+#undef SIMD_CAT
+#undef SIMD_CAT_
@@ -0,0 +1,166 @@
+/*
+ *  sparse.c
+ *  CS3410 (F'24)
+ *
+ *  USAGE:  sparse  [-b <block_size>] [-t <threads>] <matrix_dimension> [<density>]
+ *
+ *  OVERVIEW:  Tests the performance of the sparse (CSR and blocked-CSR) multiply
+ *     and transpose against the dense blocked kernels, on random matrices with
+ *     the given fraction of nonzeros (default SPARSE_DENSITY).  Each runs twice:
+ *     with the nonzeros scattered at random, and clustered in whole tiles of side
+ *     -b (default BSR_BLOCK), which is also the BSR block size.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "csr.h"
+#include "helpers.h"
+#include "tasks.h"
+#include "threads.h"
+#include "tune.h"
+
+// Fraction of nonzeros when no density is given
+#define SPARSE_DENSITY 0.05
+
+/*
+ * A random n x n matrix with about `density` of its elements nonzero, each a small
+ * nonzero integer (so every product below is exact).  If `clustered`, the
+ * nonzeros fill whole bs x bs tiles, chosen with probability `density`;
+ * otherwise each element is chosen on its own.
+ */
+static double *make_sparse_matrix(int n, double density, bool clustered, int bs) {
+    double *M = make_one_matrix(n);
+    int nb = (n + bs - 1) / bs;
+    bool *tiles = malloc((size_t)nb * nb * sizeof(bool));
+
+    for (long t = 0; t < (long)nb * nb; t++) {
+        tiles[t] = rand() < density * RAND_MAX;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            bool keep = clustered ? tiles[(long)(i / bs) * nb + j / bs] : rand() < density * RAND_MAX;
+
+            M[(long)i * n + j] = keep ? (double)(rand() % 7 + 1) * (rand() % 2 ? 1 : -1) : 0.0;
+        }
+    }
+    free(tiles);
+    return M;
+} // make_sparse_matrix
+
+static void print_time(const char *label, unsigned long total, const char *note) {
+    printf("  %-24s TIME TO COMPLETION = %lu msec.  %s\n", label, total, note);
+}
+
+int main(int argc, char **argv) {
+    long long start, end;
+
+    Args args = get_args(argc, argv);
+    int n = args.n;
+    double density = (optind + 1 < argc) ? atof(argv[optind + 1]) : SPARSE_DENSITY;
+    int bs = (args.blocksz > 1) ? args.blocksz : BSR_BLOCK;
+    int dense_bs = tune_block(TUNE_MATMULT_BL, n), threads = num_threads(args.threads);
+
+    if (!(density > 0.0 && density <= 1.0)) {
+        fprintf(stderr, "Bad density %s.\n", argv[optind + 1]);
+        printUsage(argv[0]);
+        exit(0);
+    }
+
+    double *B = make_one_matrix(n), *C = make_one_matrix(n), *R = make_one_matrix(n);
+    double *R_t = make_one_matrix(n), *D = make_one_matrix(n);
+
+    srand(3410);
+    for (int pattern = 0; pattern < 2; pattern++) {
+        double *A = make_sparse_matrix(n, density, pattern == 1, bs);
+        CsrMatrix S, S_t;
+        BsrMatrix Q, Q_t;
+        unsigned long total_csr, total_bsr;
+
+        start = timeInMilliseconds();
+        csr_from_dense(n, A, &S);
+        end = timeInMilliseconds();
+        total_csr = end - start;
+
+        start = timeInMilliseconds();
+        bsr_from_dense(n, bs, A, &Q);
+        end = timeInMilliseconds();
+        total_bsr = end - start;
+
+        printf("Sparse vs. dense, %d x %d, %s nonzeros (block size = %d, %d threads)\n", n, n,
+               (pattern ? "clustered" : "scattered"), bs, threads);
+        printf("---------------------------------------------------------\n");
+        printf("  density = %.4f (%ld nonzeros);  BSR keeps %ld tiles, %.1f%% full\n", (double)S.nnz / n / n,
+               S.nnz, Q.nnzb, (Q.nnzb ? 100.0 * S.nnz / Q.nnzb / bs / bs : 0.0));
+        printf("  storage:  dense %.1f MB, CSR %.1f MB, BSR %.1f MB\n", (double)n * n * sizeof(double) / 1e6,
+               (S.nnz * (sizeof(double) + sizeof(int)) + (n + 1) * sizeof(long)) / 1e6,
+               (Q.nnzb * (bs * bs * sizeof(double) + sizeof(int)) + (Q.nb + 1) * sizeof(long)) / 1e6);
+        print_time("convert to CSR", total_csr, "");
+        print_time("convert to BSR", total_bsr, "");
+
+        // The multiply:  the dense blocked kernels as the reference, then every
+        // sparse one, each checked against it
+        zero(n, R);
+        start = timeInMilliseconds();
+        matmult_bl(n, dense_bs, A, B, R);
+        end = timeInMilliseconds();
+        print_time("matmult_bl (dense)", end - start, "");
+
+        zero(n, C);
+        start = timeInMilliseconds();
+        matmult_bl_ws(n, dense_bs, threads, A, B, C);
+        end = timeInMilliseconds();
+        print_time("matmult_bl_ws (dense)", end - start, (max_abs_diff(n, R, C) == 0.0 ? "PASS" : "FAIL"));
+
+        for (int v = 0; v < 4; v++) {
+            const char *names[] = {"spmm_csr", "spmm_csr_mt", "spmm_bsr", "spmm_bsr_mt"};
+
+            zero(n, C);
+            start = timeInMilliseconds();
+            switch (v) {
+            case 0: spmm_csr(&S, 0, B, C); break;
+            case 1: spmm_csr_mt(&S, 0, threads, B, C); break;
+            case 2: spmm_bsr(&Q, 0, B, C); break;
+            default: spmm_bsr_mt(&Q, 0, threads, B, C); break;
+            }
+            end = timeInMilliseconds();
+            print_time(names[v], end - start, (max_abs_diff(n, R, C) == 0.0 ? "PASS" : "FAIL"));
+        }
+
+        // The transpose, each sparse one converted back to dense to check it
+        start = timeInMilliseconds();
+        transpose_bl(n, 0, A, R_t);
+        end = timeInMilliseconds();
+        print_time("transpose_bl (dense)", end - start, "");
+
+        start = timeInMilliseconds();
+        csr_transpose(&S, &S_t);
+        end = timeInMilliseconds();
+        csr_to_dense(&S_t, D);
+        print_time("csr_transpose", end - start, (max_abs_diff(n, R_t, D) == 0.0 ? "PASS" : "FAIL"));
+
+        start = timeInMilliseconds();
+        bsr_transpose(&Q, &Q_t);
+        end = timeInMilliseconds();
+        bsr_to_dense(&Q_t, D);
+        print_time("bsr_transpose", end - start, (max_abs_diff(n, R_t, D) == 0.0 ? "PASS" : "FAIL"));
+        printf("---------------------------------------------------------\n\n");
+
+        csr_free(&S);
+        csr_free(&S_t);
+        bsr_free(&Q);
+        bsr_free(&Q_t);
+        matrix_free(A);
+    }
+
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(R);
+    matrix_free(R_t);
+    matrix_free(D);
+    return 0;
+} // main
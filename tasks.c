@@ -1,5 +1,13 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
 #include "helpers.h"
+#include "simd.h"
 #include "tasks.h"
+#include "threads.h"
+#include "tune.h"
 
 /*
  * TASK 0a
@@ -55,48 +63,982 @@ void matmult_cm(int n, double* A, double* B, double* C) {
  * To make this work, you will also need to refactor the bodies of the inner
  * and middle loops a little, so that the loops are perfectly nested.
  *
+ * The inner j loop is the vectorized Simd.axpy kernel (see simd.c).
+ *
  * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
  * initialized to zero.
  */
 void matmult_li(int n, double* A, double* B, double* C) {
     for (int i = 0; i < n; i++) {
         for (int k = 0; k < n; k++) {
-            for (int j = 0; j < n; j++) {
-                C[i * n + j] += A[i * n + k] * B[k * n + j];
+            Simd.axpy(n, A[i * n + k], B + k * n, C + i * n);
+        }
+    }
+}
+/*
+ * One (i_start, j_start, k_start) tile of matmult_bl, with the tile extents given
+ * explicitly.  When the extents are compile-time constants the compiler can fully
+ * unroll and vectorize the loops.
+ */
+static inline __attribute__((always_inline)) void matmult_bl_tile(int n, double* A, double* B, double* C,
+                                                                  int i_start, int j_start, int k_start,
+                                                                  int i_len, int j_len, int k_len) {
+    for (int i = i_start; i < i_start + i_len; i++) {
+        for (int j = j_start; j < j_start + j_len; j++) {
+            double sum = 0.0;
+            for (int k = k_start; k < k_start + k_len; k++) {
+                sum += A[i * n + k] * B[k * n + j];
             }
+            C[i * n + j] += sum;
         }
     }
 }
+
+/*
+ * All of tile (ii, jj) of C:  accumulates every k-tile of A's row block ii times
+ * B's column block jj into it.  Returns false if check_shortcircuit cut the work
+ * short; the `sc` flag turns that check off for callers that run tiles on several
+ * threads at once.
+ *
+ * Each full k-tile goes to Simd.bl_fixed[bs], the vectorized kernel built for that
+ * constant size, when there is one;  other tiles go to Simd.bl_tile, and at
+ * SIMD_SCALAR to matmult_bl_tile.  Always inlined, so that each fixed-size wrapper
+ * below gets its own copy with `bs` folded into a constant:  the block loops, the
+ * table lookup and (at SIMD_SCALAR) the interior tiles all see constant bounds.
+ */
+static inline __attribute__((always_inline)) bool matmult_bl_ctile(int n, int bs, double* A, double* B,
+                                                                   double* C, int ii, int jj, bool sc) {
+    int n_blocks = (n + bs - 1) / bs; // Ceiling division to cover all elements
+
+    int i_start = ii * bs;
+    int i_end = (i_start + bs < n) ? (i_start + bs) : n;
+    int j_start = jj * bs;
+    int j_end = (j_start + bs < n) ? (j_start + bs) : n;
+
+    for (int kk = 0; kk < n_blocks; kk++) {
+        int k_start = kk * bs;
+        int k_end = (k_start + bs < n) ? (k_start + bs) : n;
+
+        if (sc && check_shortcircuit()) return false;
+
+        bool full = (i_end - i_start == bs && j_end - j_start == bs && k_end - k_start == bs);
+        if (full && bs <= FIXED_BLOCK_MAX && Simd.bl_fixed && Simd.bl_fixed[bs]) {
+            Simd.bl_fixed[bs](n, A, B, C, i_start, j_start, k_start);
+        } else if (Simd.bl_tile) {
+            Simd.bl_tile(n, A, B, C, i_start, j_start, k_start,
+                         i_end - i_start, j_end - j_start, k_end - k_start);
+        } else if (full) {
+            matmult_bl_tile(n, A, B, C, i_start, j_start, k_start, bs, bs, bs);
+        } else {
+            matmult_bl_tile(n, A, B, C, i_start, j_start, k_start,
+                            i_end - i_start, j_end - j_start, k_end - k_start);
+        }
+    }
+    return true;
+}
+
+/*
+ * The block loops of matmult_bl.
+ */
+static inline __attribute__((always_inline)) void matmult_bl_kernel(int n, int bs, double* A, double* B,
+                                                                    double* C) {
+    int n_blocks = (n + bs - 1) / bs;
+
+    for (int ii = 0; ii < n_blocks; ii++) {
+        for (int jj = 0; jj < n_blocks; jj++) {
+            if (!matmult_bl_ctile(n, bs, A, B, C, ii, jj, true)) return;
+        }
+    }
+}
+
+/*
+ * Computes one tile of C for the multithreaded kernels.
+ */
+typedef void (*BlockFn)(int n, int bs, double* A, double* B, double* C, int ii, int jj);
+
+static void matmult_bl_ctile_any(int n, int bs, double* A, double* B, double* C, int ii, int jj) {
+    matmult_bl_ctile(n, bs, A, B, C, ii, jj, false);
+}
+
+#define MATMULT_BL_FIXED(BS)                                                           \
+    static void matmult_bl_##BS(int n, double* A, double* B, double* C) {              \
+        matmult_bl_kernel(n, BS, A, B, C);                                             \
+    }                                                                                  \
+    static void matmult_bl_ctile_##BS(int n, int bs, double* A, double* B, double* C,  \
+                                      int ii, int jj) {                                \
+        (void)bs;                                                                      \
+        matmult_bl_ctile(n, BS, A, B, C, ii, jj, false);                               \
+    }
+
+MATMULT_BL_FIXED(8)
+MATMULT_BL_FIXED(16)
+MATMULT_BL_FIXED(32)
+MATMULT_BL_FIXED(64)
+
+/*
+ * The per-tile kernel for block size bs, with the same fast paths as matmult_bl.
+ */
+static BlockFn matmult_bl_ctile_fn(int bs) {
+    switch (bs) {
+    case 8:  return matmult_bl_ctile_8;
+    case 16: return matmult_bl_ctile_16;
+    case 32: return matmult_bl_ctile_32;
+    case 64: return matmult_bl_ctile_64;
+    default: return matmult_bl_ctile_any;
+    }
+}
+
 /*
  * TASK 1
  *
- * Like `matmult`, but use blocking. The block size is `BLOCKSZ`.
+ * Like `matmult`, but use blocking. The block size is `blocksz`; a value <= 0
+ * selects this host's tuned size for n (see tune.h), or without a profile the
+ * compile-time default, `BLOCKSZ`.
+ *
+ * Block sizes 8, 16, 32 and 64 dispatch to kernels specialized for that constant,
+ * so they run as fast as a build with -DBLOCKSZ=<size>.  Any other size falls back
+ * to the generic kernel.
  *
  * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
  * initialized to zero.
  */
-void matmult_bl(int n, double* A, double* B, double* C) {
-    int n_blocks = (n + BLOCKSZ - 1) / BLOCKSZ; // Ceiling division to cover all elements
+void matmult_bl(int n, int blocksz, double* A, double* B, double* C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
 
-    for (int ii = 0; ii < n_blocks; ii++) {
-        int i_start = ii * BLOCKSZ;
-        int i_end = (i_start + BLOCKSZ < n) ? (i_start + BLOCKSZ) : n;
+    switch (blocksz) {
+    case 8:  matmult_bl_8(n, A, B, C); break;
+    case 16: matmult_bl_16(n, A, B, C); break;
+    case 32: matmult_bl_32(n, A, B, C); break;
+    case 64: matmult_bl_64(n, A, B, C); break;
+    default: matmult_bl_kernel(n, blocksz, A, B, C); break;
+    }
+}
 
-        for (int jj = 0; jj < n_blocks; jj++) {
-            int j_start = jj * BLOCKSZ;
-            int j_end = (j_start + BLOCKSZ < n) ? (j_start + BLOCKSZ) : n;
+typedef struct bl_job_t {
+    int n, bs, n_blocks;
+    double *A, *B, *C;
+    BlockFn fn;
+} BlJob;
+
+static void matmult_bl_job_tile(void* ctx, int tile) {
+    BlJob* job = ctx;
+    job->fn(job->n, job->bs, job->A, job->B, job->C, tile / job->n_blocks, tile % job->n_blocks);
+}
+
+/*
+ * TASK 4
+ *
+ * matmult_bl on `nthreads` threads (<= 0 means one per online CPU).  The
+ * (ii, jj) tiles of C are split across the threads, and each thread runs the
+ * whole k loop for the tiles it owns, so no two threads ever write the same
+ * element of C.  Every element sees exactly the same sequence of floating-point
+ * operations as in matmult_bl, so the result is bit-for-bit identical to the
+ * serial kernel for any thread count.
+ *
+ * The short-circuit test hook (check_shortcircuit) is not thread-safe and is
+ * not consulted here.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_bl_mt(int n, int blocksz, int nthreads, double* A, double* B, double* C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    int n_blocks = (n + blocksz - 1) / blocksz;
+    BlJob job = {
+        .n = n, .bs = blocksz, .n_blocks = n_blocks, .A = A, .B = B, .C = C,
+        .fn = matmult_bl_ctile_fn(blocksz),
+    };
+    run_tiles_static(nthreads, n_blocks * n_blocks, matmult_bl_job_tile, &job);
+}
+
+/*
+ * TASK 5
+ *
+ * matmult_bl_mt, scheduled by work stealing (see run_tiles_ws) rather than a
+ * static split.  When blocksz doesn't divide n, the tiles on the bottom and right
+ * edges of C are smaller than the rest; with stealing, the threads that finish
+ * their share early pick up work from the others instead of idling.  The result
+ * is bit-for-bit identical to matmult_bl, for the same reason as matmult_bl_mt.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_bl_ws(int n, int blocksz, int nthreads, double* A, double* B, double* C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    int n_blocks = (n + blocksz - 1) / blocksz;
+    BlJob job = {
+        .n = n, .bs = blocksz, .n_blocks = n_blocks, .A = A, .B = B, .C = C,
+        .fn = matmult_bl_ctile_fn(blocksz),
+    };
+    run_tiles_ws(nthreads, n_blocks * n_blocks, matmult_bl_job_tile, &job);
+}
+
+/*
+ * Tile (ii, jj) of matmult_bl's C on its own, with the same specialized kernels,
+ * for schedulers outside this file (see jobs.c).  The short-circuit hook is not
+ * consulted.
+ */
+void matmult_bl_ctile_at(int n, int blocksz, double* A, double* B, double* C, int ii, int jj) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    matmult_bl_ctile_fn(blocksz)(n, blocksz, A, B, C, ii, jj);
+}
+
+// Recursion stops once every dimension of a subproblem is at most this; a
+// multiple of every vector width and of the blocked kernel's 4-row step.
+#define REC_MM_BASE 64
+
+/*
+ * Where to cut a side of length len > REC_MM_BASE:  about halfway, on a multiple
+ * of REC_MM_BASE.
+ */
+static int rec_half(int len) {
+    int half = len / 2 / REC_MM_BASE * REC_MM_BASE;
+    return half ? half : REC_MM_BASE;
+}
+
+/*
+ * C[i0:i0+m][j0:j0+p] += A[i0:i0+m][k0:k0+q] * B[k0:k0+q][j0:j0+p], by halving the
+ * largest of m, p and q.  Halving q splits the sum in two, so those halves run one
+ * after the other, into the same part of C.
+ */
+static void matmult_rec_tile(int n, double* A, double* B, double* C, int i0, int j0, int k0, int m, int p,
+                             int q) {
+    if (m <= REC_MM_BASE && p <= REC_MM_BASE && q <= REC_MM_BASE) {
+        if (Simd.bl_tile) {
+            Simd.bl_tile(n, A, B, C, i0, j0, k0, m, p, q);
+        } else {
+            matmult_bl_tile(n, A, B, C, i0, j0, k0, m, p, q);
+        }
+    } else if (m >= p && m >= q) {
+        int half = rec_half(m);
+        matmult_rec_tile(n, A, B, C, i0, j0, k0, half, p, q);
+        matmult_rec_tile(n, A, B, C, i0 + half, j0, k0, m - half, p, q);
+    } else if (p >= q) {
+        int half = rec_half(p);
+        matmult_rec_tile(n, A, B, C, i0, j0, k0, m, half, q);
+        matmult_rec_tile(n, A, B, C, i0, j0 + half, k0, m, p - half, q);
+    } else {
+        int half = rec_half(q);
+        matmult_rec_tile(n, A, B, C, i0, j0, k0, m, p, half);
+        matmult_rec_tile(n, A, B, C, i0, j0, k0 + half, m, p, q - half);
+    }
+}
+
+/*
+ * TASK 9
+ *
+ * A cache-oblivious multiplication:  the problem is split in half along its
+ * largest dimension, over and over, down to REC_MM_BASE-sized subproblems, which run
+ * the blocked kernel (Simd.bl_tile, or matmult_bl's scalar tile).  At every level
+ * of the recursion some subproblem's three operands fit in each level of cache,
+ * whatever its size, so there is no block size to tune per host.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_rec(int n, double* A, double* B, double* C) {
+    matmult_rec_tile(n, A, B, C, 0, 0, 0, n, n, n);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Multi-level tiled multiplication, in the style of GotoBLAS/BLIS.
+ */
+TileSizes Tile_Sizes = {.kc = 128, .mc = 96, .nc = 2048};
+
+/*
+ * The register-blocked micro-kernel:  C[0:MM_MR][0:MM_NR] += A[0:MM_MR][0:kc] * B[0:kc][0:MM_NR],
+ * where each matrix is addressed through its own leading dimension (row stride).
+ * Simd.micro keeps the MM_MR x MM_NR outputs in vector registers for the whole
+ * k-panel, and each step loads one short, contiguous row of B instead of a
+ * stride-n column.
+ */
+static void micro_kernel(int kc, double* A, int lda, double* B, int ldb, double* C, int ldc) {
+    double c[MM_MR][MM_NR];
+
+    Simd.micro(kc, A, lda, B, ldb, c);
+
+    for (int i = 0; i < MM_MR; i++) {
+        for (int j = 0; j < MM_NR; j++) {
+            C[i * ldc + j] += c[i][j];
+        }
+    }
+}
+
+/*
+ * micro_kernel for the ragged mr x nr tiles (mr <= MM_MR, nr <= MM_NR) along the
+ * bottom and right edges of C.
+ */
+static void micro_kernel_edge(int mr, int nr, int kc, double* A, int lda, double* B, int ldb, double* C,
+                              int ldc) {
+    double c[MM_MR][MM_NR] = {{0.0}};
+
+    for (int k = 0; k < kc; k++) {
+        double* b = B + k * ldb;
+        for (int i = 0; i < mr; i++) {
+            double a = A[i * lda + k];
+            for (int j = 0; j < nr; j++) {
+                c[i][j] += a * b[j];
+            }
+        }
+    }
 
-            for (int kk = 0; kk < n_blocks; kk++) {
-                int k_start = kk * BLOCKSZ;
-                int k_end = (k_start + BLOCKSZ < n) ? (k_start + BLOCKSZ) : n;
+    for (int i = 0; i < mr; i++) {
+        for (int j = 0; j < nr; j++) {
+            C[i * ldc + j] += c[i][j];
+        }
+    }
+}
+
+/*
+ * One mc x nc x kc macro-tile:  walks the MM_MR x MM_NR register tiles of C, with
+ * the j loop outside so that each kc x MM_NR sliver of B is reused (from L1) by
+ * every row sliver of A in the macro-tile.
+ */
+static void macro_kernel(int mc, int nc, int kc, double* A, int lda, double* B, int ldb, double* C,
+                         int ldc) {
+    for (int jr = 0; jr < nc; jr += MM_NR) {
+        int nr = (nc - jr < MM_NR) ? (nc - jr) : MM_NR;
+
+        for (int ir = 0; ir < mc; ir += MM_MR) {
+            int mr = (mc - ir < MM_MR) ? (mc - ir) : MM_MR;
+
+            if (mr == MM_MR && nr == MM_NR) {
+                micro_kernel(kc, A + ir * lda, lda, B + jr, ldb, C + ir * ldc + jr, ldc);
+            } else {
+                micro_kernel_edge(mr, nr, kc, A + ir * lda, lda, B + jr, ldb, C + ir * ldc + jr, ldc);
+            }
+        }
+    }
+}
+
+/*
+ * TASK 2
+ *
+ * Like `matmult_bl`, but with a separate tile size for each level of the memory
+ * hierarchy (see TileSizes) and a register-blocked micro-kernel at the bottom:
+ *
+ *   for each nc-wide column panel of B and C          (L3)
+ *     for each kc-deep slice of that panel            (L1)
+ *       for each mc-tall row block of A and C         (L2)
+ *         for each MM_MR x MM_NR tile of C            (registers)
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_tiled(int n, double* A, double* B, double* C) {
+    int kc = Tile_Sizes.kc, mc = Tile_Sizes.mc, nc = Tile_Sizes.nc;
+
+    for (int jc = 0; jc < n; jc += nc) {
+        int nb = (n - jc < nc) ? (n - jc) : nc;
+
+        for (int pc = 0; pc < n; pc += kc) {
+            int kb = (n - pc < kc) ? (n - pc) : kc;
+
+            for (int ic = 0; ic < n; ic += mc) {
+                int mb = (n - ic < mc) ? (n - ic) : mc;
 
                 if (check_shortcircuit()) return;
+                macro_kernel(mb, nb, kb, A + ic * n + pc, n, B + pc * n + jc, n, C + ic * n + jc, n);
+            }
+        }
+    }
+}
+
+/*
+ * Copies alpha times the mc x kc block of A at A[0][0] into Ap, as a sequence of
+ * MM_MR-row slivers.  Element (i, k) of the block is A[i * rs + k * cs], so the
+ * same routine packs a row-major block (rs = lda, cs = 1) or the transpose of one
+ * (rs = 1, cs = lda).  Within a sliver the elements are stored column by column,
+ * so the micro-kernel reads the MM_MR values it needs for step k as one
+ * contiguous run.  The last sliver is padded with zeros up to MM_MR rows.
+ */
+static void pack_A(int mc, int kc, double* A, int rs, int cs, double alpha, double* Ap) {
+    for (int ir = 0; ir < mc; ir += MM_MR) {
+        int mr = (mc - ir < MM_MR) ? (mc - ir) : MM_MR;
+
+        for (int k = 0; k < kc; k++) {
+            for (int i = 0; i < mr; i++) {
+                *Ap++ = alpha * A[(ir + i) * rs + k * cs];
+            }
+            for (int i = mr; i < MM_MR; i++) {
+                *Ap++ = 0.0;
+            }
+        }
+    }
+}
 
-                for (int i = i_start; i < i_end; i++) {
-                    for (int j = j_start; j < j_end; j++) {
+/*
+ * Copies the kc x nc panel of B at B[0][0] into Bp, as a sequence of MM_NR-column
+ * slivers stored row by row, so that the micro-kernel walks each sliver with unit
+ * stride.  Element (k, j) of the panel is B[k * rs + j * cs], as in pack_A.  The
+ * last sliver is padded with zeros up to MM_NR columns.
+ */
+static void pack_B(int kc, int nc, double* B, int rs, int cs, double* Bp) {
+    for (int jr = 0; jr < nc; jr += MM_NR) {
+        int nr = (nc - jr < MM_NR) ? (nc - jr) : MM_NR;
+
+        for (int k = 0; k < kc; k++) {
+            for (int j = 0; j < nr; j++) {
+                *Bp++ = B[k * rs + (jr + j) * cs];
+            }
+            for (int j = nr; j < MM_NR; j++) {
+                *Bp++ = 0.0;
+            }
+        }
+    }
+}
+
+/*
+ * micro_kernel over packed slivers:  Ap is a kc-long MM_MR sliver from pack_A and
+ * Bp a kc-long MM_NR sliver from pack_B.  Because the slivers are zero-padded,
+ * the full MM_MR x MM_NR product is always computed, and only the mr x nr corner
+ * that lies inside C is written back.
+ */
+static void micro_kernel_packed(int mr, int nr, int kc, double* Ap, double* Bp, double* C, int ldc) {
+    double c[MM_MR][MM_NR];
+
+    Simd.micro_packed(kc, Ap, Bp, c);
+
+    if (mr == MM_MR && nr == MM_NR) {
+        for (int i = 0; i < MM_MR; i++) {
+            for (int j = 0; j < MM_NR; j++) {
+                C[i * ldc + j] += c[i][j];
+            }
+        }
+    } else {
+        for (int i = 0; i < mr; i++) {
+            for (int j = 0; j < nr; j++) {
+                C[i * ldc + j] += c[i][j];
+            }
+        }
+    }
+}
+
+/*
+ * macro_kernel over a packed mc x kc block of A and a packed kc x nc panel of B.
+ */
+static void macro_kernel_packed(int mc, int nc, int kc, double* Ap, double* Bp, double* C, int ldc) {
+    for (int jr = 0; jr < nc; jr += MM_NR) {
+        int nr = (nc - jr < MM_NR) ? (nc - jr) : MM_NR;
+
+        for (int ir = 0; ir < mc; ir += MM_MR) {
+            int mr = (mc - ir < MM_MR) ? (mc - ir) : MM_MR;
+
+            micro_kernel_packed(mr, nr, kc, Ap + ir * kc, Bp + jr * kc, C + ir * ldc + jr, ldc);
+        }
+    }
+}
+
+/*
+ * Rounds `x` up to the next multiple of `m`.
+ */
+static size_t round_up(size_t x, size_t m) {
+    return (x + m - 1) / m * m;
+}
+
+/*
+ * Bytes needed for the packed block of A and the packed panel of B:  panels are
+ * padded out to whole slivers, and to a whole number of cache lines.
+ */
+static size_t packed_A_bytes(void) {
+    return round_up(round_up(Tile_Sizes.mc, MM_MR) * Tile_Sizes.kc * sizeof(double), 64);
+}
+
+static size_t packed_B_bytes(void) {
+    return round_up(round_up(Tile_Sizes.nc, MM_NR) * Tile_Sizes.kc * sizeof(double), 64);
+}
+
+/*
+ * The loop nest of matmult_packed, for a general product with arbitrary strides:
+ * C[0:m][0:n] += alpha * A[0:m][0:k] * B[0:k][0:n], where element (i, p) of A is
+ * A[i * rsa + p * csa], element (p, j) of B is B[p * rsb + j * csb], and row i of
+ * C starts at C + i * ldc.  Ap and Bp are 64-byte-aligned packing buffers of
+ * packed_A_bytes() and packed_B_bytes().  Returns false if the short-circuit hook
+ * (consulted only when `sc` is set) cut the work short.
+ */
+static bool packed_kernel(int m, int n, int k, double alpha, double* A, int rsa, int csa, double* B, int rsb,
+                          int csb, double* C, int ldc, double* Ap, double* Bp, bool sc) {
+    int kc = Tile_Sizes.kc, mc = Tile_Sizes.mc, nc = Tile_Sizes.nc;
+
+    for (int jc = 0; jc < n; jc += nc) {
+        int nb = (n - jc < nc) ? (n - jc) : nc;
+
+        for (int pc = 0; pc < k; pc += kc) {
+            int kb = (k - pc < kc) ? (k - pc) : kc;
+
+            pack_B(kb, nb, B + pc * rsb + jc * csb, rsb, csb, Bp);
+
+            for (int ic = 0; ic < m; ic += mc) {
+                int mb = (m - ic < mc) ? (m - ic) : mc;
+
+                if (sc && check_shortcircuit()) return false;
+                pack_A(mb, kb, A + ic * rsa + pc * csa, rsa, csa, alpha, Ap);
+                macro_kernel_packed(mb, nb, kb, Ap, Bp, C + ic * ldc + jc, ldc);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * TASK 3
+ *
+ * matmult_tiled, with A and B packed before they reach the micro-kernel.  This
+ * takes the realignment idea behind matmult_cm (where B is transposed up front)
+ * down to the tile level:  each kc x nc panel of B and each mc x kc block of A is
+ * copied into a contiguous, 64-byte-aligned buffer, in exactly the order the
+ * micro-kernel reads it.  The packed B panel is then reused by every mc-row block
+ * of A.  Packing removes the stride-n walk down B, so a k-panel no longer touches
+ * kc different pages, nor (for power-of-two n) kc rows that all map to the same
+ * cache set.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_packed(int n, double* A, double* B, double* C) {
+    double* Ap = matrix_alloc(packed_A_bytes());
+    double* Bp = matrix_alloc(packed_B_bytes());
+
+    // Without the packing buffers, the same tiling on A and B in place
+    if (!Ap || !Bp) {
+        matrix_free(Ap);
+        matrix_free(Bp);
+        matmult_tiled(n, A, B, C);
+        return;
+    }
+    packed_kernel(n, n, n, 1.0, A, n, 1, B, n, 1, C, n, Ap, Bp, true);
+
+    matrix_free(Ap);
+    matrix_free(Bp);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Fused transpose-and-multiply.
+ */
+// matmult_fused makes at least this many column blocks of C per thread (while
+// they are wider than MM_NR), so that work stealing can even out the load
+#define FUSED_SPLIT 4
+
+typedef struct fused_job_t {
+    int n, w, nblocks; // column blocks of C:  nblocks of them, w wide (a multiple of MM_NR)
+    double *A, *B, *C;
+    atomic_int next; // the next column block to claim
+} FusedJob;
+
+/*
+ * One worker of matmult_fused.  It claims column blocks of C until there are none
+ * left.  For each kc-deep slice of a block, the kc x w piece of B it needs is
+ * copied into the worker's own panel buffer, contiguous and 64-byte aligned, and
+ * every mc-tall row block of C down the column block is then accumulated from it
+ * by macro_kernel.  Only this worker writes those columns of C.  If the buffer
+ * can't be allocated, macro_kernel reads the piece of B in place instead.
+ */
+static void matmult_fused_worker(void* ctx, int worker) {
+    (void)worker;
+    FusedJob* job = ctx;
+    int n = job->n, w = job->w, kc = Tile_Sizes.kc, mc = Tile_Sizes.mc;
+    double* P = matrix_alloc((size_t)kc * w * sizeof(double));
+
+    for (int jb; (jb = atomic_fetch_add(&job->next, 1)) < job->nblocks;) {
+        int j0 = jb * w, jlen = (j0 + w < n) ? w : n - j0;
+
+        for (int k0 = 0; k0 < n; k0 += kc) {
+            int klen = (k0 + kc < n) ? kc : n - k0;
+            double* Bk = P ? P : job->B + (size_t)k0 * n + j0;
+            int ldb = P ? w : n;
+
+            for (int k = 0; P && k < klen; k++) {
+                memcpy(P + (size_t)k * w, job->B + (size_t)(k0 + k) * n + j0, jlen * sizeof(double));
+            }
+            for (int i0 = 0; i0 < n; i0 += mc) {
+                int ilen = (i0 + mc < n) ? mc : n - i0;
+                macro_kernel(ilen, jlen, klen, job->A + (size_t)i0 * n + k0, n, Bk, ldb,
+                             job->C + (size_t)i0 * n + j0, n);
+            }
+        }
+    }
+    matrix_free(P);
+}
+
+/*
+ * TASK 23
+ *
+ * C = A * B without a transposed copy of B.  The two-phase flow (transpose B into
+ * an n x n B_t, then matmult_cm) reads B twice, writes B_t once, and needs n^2
+ * more doubles.  Here B is packed a kc x w panel at a time (kc from Tile_Sizes, w
+ * a multiple of MM_NR no wider than Tile_Sizes.nc) just before the multiply uses
+ * it, while it is still in cache, so B is read exactly once and the extra memory
+ * is one panel per thread.  The column blocks of C are shared out among
+ * `nthreads` threads (<= 0 means one per online CPU) as each finishes its last.
+ * The short-circuit hook is not consulted.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_fused(int n, int nthreads, double* A, double* B, double* C) {
+    nthreads = num_threads(nthreads);
+
+    int w = (int)round_up((n + FUSED_SPLIT * nthreads - 1) / (FUSED_SPLIT * nthreads), MM_NR);
+    int nc = (int)round_up(Tile_Sizes.nc, MM_NR);
+    if (w > nc) w = nc;
+
+    FusedJob job = {.n = n, .w = w, .nblocks = (n + w - 1) / w, .A = A, .B = B, .C = C};
+    atomic_init(&job.next, 0);
+    run_tiles_static(nthreads, nthreads, matmult_fused_worker, &job);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Strassen-Winograd multiplication.
+ */
+int Strassen_Crossover = 512;
+
+/*
+ * Takes `count` doubles from the scratch arena.  The arena is sized up front, so
+ * this never fails.
+ */
+static double* scratch_take(Arena* s, size_t count) {
+    return arena_take(s, count * sizeof(double));
+}
+
+// Z = X + Y, and Z = X - Y, for h x h blocks with their own leading dimensions.
+static void block_add(int h, double* X, int ldx, double* Y, int ldy, double* Z, int ldz) {
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < h; j++) {
+            Z[i * ldz + j] = X[i * ldx + j] + Y[i * ldy + j];
+        }
+    }
+}
+
+static void block_sub(int h, double* X, int ldx, double* Y, int ldy, double* Z, int ldz) {
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < h; j++) {
+            Z[i * ldz + j] = X[i * ldx + j] - Y[i * ldy + j];
+        }
+    }
+}
+
+/*
+ * C = A * B for m x m blocks (C's previous contents are ignored).  Above the
+ * crossover, and while m is even, this is one level of Winograd's variant of
+ * Strassen's algorithm: 7 half-size products and 15 additions.  The order of the
+ * steps follows Douglas et al. (1994), which needs only two h x h temporaries, X
+ * and Y, per level; C's own quadrants hold the partial results.
+ */
+static void strassen_rec(int m, double* A, int lda, double* B, int ldb, double* C, int ldc, Arena* s,
+                         double* Ap, double* Bp) {
+    if (m <= Strassen_Crossover || m % 2) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < m; j++) {
+                C[i * ldc + j] = 0.0;
+            }
+        }
+        packed_kernel(m, m, m, 1.0, A, lda, 1, B, ldb, 1, C, ldc, Ap, Bp, false);
+        return;
+    }
+
+    int h = m / 2;
+    double *A11 = A, *A12 = A + h, *A21 = A + h * lda, *A22 = A + h * lda + h;
+    double *B11 = B, *B12 = B + h, *B21 = B + h * ldb, *B22 = B + h * ldb + h;
+    double *C11 = C, *C12 = C + h, *C21 = C + h * ldc, *C22 = C + h * ldc + h;
+
+    size_t mark = s->used;
+    double* X = scratch_take(s, (size_t)h * h);
+    double* Y = scratch_take(s, (size_t)h * h);
+
+    block_sub(h, A11, lda, A21, lda, X, h);                   // X = S3 = A11 - A21
+    block_sub(h, B22, ldb, B12, ldb, Y, h);                   // Y = T3 = B22 - B12
+    strassen_rec(h, X, h, Y, h, C21, ldc, s, Ap, Bp);         // C21 = P7 = S3 T3
+    block_add(h, A21, lda, A22, lda, X, h);                   // X = S1 = A21 + A22
+    block_sub(h, B12, ldb, B11, ldb, Y, h);                   // Y = T1 = B12 - B11
+    strassen_rec(h, X, h, Y, h, C22, ldc, s, Ap, Bp);         // C22 = P5 = S1 T1
+    block_sub(h, X, h, A11, lda, X, h);                       // X = S2 = S1 - A11
+    block_sub(h, B22, ldb, Y, h, Y, h);                       // Y = T2 = B22 - T1
+    strassen_rec(h, X, h, Y, h, C12, ldc, s, Ap, Bp);         // C12 = P6 = S2 T2
+    block_sub(h, A12, lda, X, h, X, h);                       // X = S4 = A12 - S2
+    strassen_rec(h, X, h, B22, ldb, C11, ldc, s, Ap, Bp);     // C11 = P3 = S4 B22
+    strassen_rec(h, A11, lda, B11, ldb, X, h, s, Ap, Bp);     // X = P1 = A11 B11
+    block_add(h, X, h, C12, ldc, C12, ldc);                   // C12 = U2 = P1 + P6
+    block_add(h, C12, ldc, C21, ldc, C21, ldc);               // C21 = U3 = U2 + P7
+    block_add(h, C12, ldc, C22, ldc, C12, ldc);               // C12 = U4 = U2 + P5
+    block_add(h, C21, ldc, C22, ldc, C22, ldc);               // C22 = U7 = U3 + P5
+    block_add(h, C12, ldc, C11, ldc, C12, ldc);               // C12 = U5 = U4 + P3
+    block_sub(h, Y, h, B21, ldb, Y, h);                       // Y = T4 = T2 - B21
+    strassen_rec(h, A22, lda, Y, h, C11, ldc, s, Ap, Bp);     // C11 = P4 = A22 T4
+    block_sub(h, C21, ldc, C11, ldc, C21, ldc);               // C21 = U6 = U3 - P4
+    strassen_rec(h, A12, lda, B21, ldb, C11, ldc, s, Ap, Bp); // C11 = P2 = A12 B21
+    block_add(h, X, h, C11, ldc, C11, ldc);                   // C11 = U1 = P1 + P2
+
+    s->used = mark;
+}
+
+/*
+ * TASK 10
+ *
+ * C = A * B by the Strassen-Winograd algorithm, in O(n^2.81) operations.  The
+ * matrix is halved until it is at most Strassen_Crossover on a side (tunable; the
+ * best value depends on the machine), and below that the packed kernel of
+ * matmult_packed takes over.  If n doesn't halve evenly that many times, A, B and
+ * C are padded with zeros up to the next size that does.  All temporaries,
+ * including the padded copies and the packing buffers, come from one scratch
+ * arena sized up front; the recursion itself never calls malloc.  Each level
+ * takes its temporaries on the way down and gives them back on the way up.  If
+ * the arena can't be allocated, the product comes from matmult_tiled instead.
+ *
+ * ERROR BOUND:  the result is not as accurate as the O(n^3) kernels'.  For the
+ * classical algorithm, each element satisfies |C - C'| <= n u |A| |B| (u = 2^-53,
+ * the unit roundoff; |A| elementwise).  For Winograd's variant with l levels of
+ * recursion above a base case of size n0 = n / 2^l, the best known bound is only
+ * normwise (Higham, "Accuracy and Stability of Numerical Algorithms", 2nd ed.,
+ * Thm 23.4):
+ *
+ *   max|C - C'| <= [ (n/n0)^log2(18) (n0^2 + 6 n0) - 6n ] u max|A| max|B|
+ *
+ * which grows by about a factor of 18 per level.  In practice the error is far
+ * below the bound, but large elements of A or B can swamp small ones of C.
+ * Results on small-integer matrices (as in the test drivers) are exact.
+ *
+ * PRECONDITIONS:  A, B, and C are all n x n row-major matrices. C is
+ * initialized to zero.
+ */
+void matmult_strassen(int n, double* A, double* B, double* C) {
+    // Pick the number of levels, and the padded size m = m0 * 2^levels >= n.  (A
+    // crossover below 1 is taken as 1, where the halving stops anyway.)
+    int cross = (Strassen_Crossover < 1 ? 1 : Strassen_Crossover);
+    int levels = 0, m0 = n;
+    while (m0 > cross) {
+        m0 = (m0 + 1) / 2;
+        levels++;
+    }
+    int m = m0 << levels;
+
+    // Size the scratch arena: padded copies, two temporaries per level, and the
+    // packing buffers (each rounded up to the arena's alignment).
+    size_t need = round_up(packed_A_bytes(), MATRIX_ALIGN) + round_up(packed_B_bytes(), MATRIX_ALIGN);
+    if (m != n) need += 3 * round_up((size_t)m * m * sizeof(double), MATRIX_ALIGN);
+    for (int l = 1, h = m / 2; l <= levels; l++, h /= 2) {
+        need += 2 * round_up((size_t)h * h * sizeof(double), MATRIX_ALIGN);
+    }
+
+    // Without the arena, the classical tiled kernel, which needs no scratch at all
+    Arena s = {0};
+    if (!arena_reserve(&s, need)) {
+        matmult_tiled(n, A, B, C);
+        return;
+    }
+    double* Ap = scratch_take(&s, packed_A_bytes() / sizeof(double));
+    double* Bp = scratch_take(&s, packed_B_bytes() / sizeof(double));
+
+    if (m == n) {
+        strassen_rec(n, A, n, B, n, C, n, &s, Ap, Bp);
+    } else {
+        double* Am = scratch_take(&s, (size_t)m * m);
+        double* Bm = scratch_take(&s, (size_t)m * m);
+        double* Cm = scratch_take(&s, (size_t)m * m);
+
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < m; j++) {
+                Am[i * m + j] = (i < n && j < n) ? A[i * n + j] : 0.0;
+                Bm[i * m + j] = (i < n && j < n) ? B[i * n + j] : 0.0;
+            }
+        }
+        strassen_rec(m, Am, m, Bm, m, Cm, m, &s, Ap, Bp);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                C[i * n + j] = Cm[i * m + j];
+            }
+        }
+    }
+
+    arena_free(&s);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * TASK 11
+ *
+ * General matrix multiplication, in the style of BLAS dgemm:
+ *
+ *   C = alpha * op(A) * op(B) + beta * C
+ *
+ * where op(A) is m x k, op(B) is k x n and C is m x n, and op(X) is X, or X's
+ * transpose if trans_x is set.  All three are row-major with their own leading
+ * dimension (the distance between the starts of consecutive rows), so they can be
+ * sub-blocks of larger matrices:  A is m x k with lda >= k (k x m with lda >= m if
+ * transposed), B is k x n with ldb >= n (n x k with ldb >= k if transposed), and
+ * ldc >= n.  This runs on the packed kernel of matmult_packed; the transposes and
+ * alpha are applied for free while packing.
+ *
+ * Unlike the matmult_* kernels, C needn't be zeroed first:  with beta = 0 its old
+ * contents are never read (so may even be NaN).  The short-circuit hook is not
+ * consulted.  If the packing buffers can't be allocated, the product is
+ * accumulated by plain loops over A and B in place.
+ */
+void gemm(bool trans_a, bool trans_b, int m, int n, int k, double alpha, double* A, int lda, double* B, int ldb,
+          double beta, double* C, int ldc) {
+    if (m <= 0 || n <= 0) return;
+
+    if (beta != 1.0) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                C[i * ldc + j] = (beta == 0.0 ? 0.0 : beta * C[i * ldc + j]);
+            }
+        }
+    }
+    if (k <= 0 || alpha == 0.0) return;
+
+    double* Ap = matrix_alloc(packed_A_bytes());
+    double* Bp = matrix_alloc(packed_B_bytes());
+
+    if (!Ap || !Bp) {
+        matrix_free(Ap);
+        matrix_free(Bp);
+        for (int i = 0; i < m; i++) {
+            for (int p = 0; p < k; p++) {
+                double a = alpha * (trans_a ? A[p * lda + i] : A[i * lda + p]);
+                for (int j = 0; j < n; j++) {
+                    C[i * ldc + j] += a * (trans_b ? B[j * ldb + p] : B[p * ldb + j]);
+                }
+            }
+        }
+        return;
+    }
+    packed_kernel(m, n, k, alpha, A, (trans_a ? 1 : lda), (trans_a ? lda : 1), B, (trans_b ? 1 : ldb),
+                  (trans_b ? ldb : 1), C, ldc, Ap, Bp, false);
+
+    matrix_free(Ap);
+    matrix_free(Bp);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Symmetric and triangular multiplication, on the tiling of matmult_bl:  the
+ * same bs x bs tiles of C and k-tiles of the operands, but only the ones that
+ * aren't known in advance to be zero (or to mirror another tile).
+ */
+
+/*
+ * Mirrors the lower triangle of the n x n matrix C into its upper triangle, tile
+ * by tile:  each tile below the diagonal is transposed into its mirror image with
+ * Simd.tr_tile (the two never overlap), and each diagonal tile within itself.
+ */
+static void mirror_lower(int n, int bs, double* C) {
+    int n_blocks = (n + bs - 1) / bs;
+
+    for (int ii = 0; ii < n_blocks; ii++) {
+        int i0 = ii * bs, ilen = (i0 + bs < n) ? bs : n - i0;
+
+        for (int jj = 0; jj < ii; jj++) {
+            int j0 = jj * bs;
+
+            if (Simd.tr_tile) {
+                Simd.tr_tile(n, C, C, i0, j0, ilen, bs);
+            } else {
+                for (int i = i0; i < i0 + ilen; i++) {
+                    for (int j = j0; j < j0 + bs; j++) {
+                        C[j * n + i] = C[i * n + j];
+                    }
+                }
+            }
+        }
+        for (int i = i0; i < i0 + ilen; i++) {
+            for (int j = i + 1; j < i0 + ilen; j++) {
+                C[i * n + j] = C[j * n + i];
+            }
+        }
+    }
+}
+
+/*
+ * C[i0:i0+ilen][j0:j0+jlen] += A[i0:..][0:klen] * P[0:klen][j0:..], where A and C
+ * have leading dimension n and P is a klen x n strip of A' (see syrk).  This is
+ * matmult_bl's tile, Simd.bl_tile or its scalar fallback, with k counted from 0.
+ */
+static void syrk_tile(int n, double* A, double* P, double* C, int i0, int j0, int ilen, int jlen, int klen) {
+    if (Simd.bl_tile) {
+        Simd.bl_tile(n, A, P, C, i0, j0, 0, ilen, jlen, klen);
+    } else {
+        matmult_bl_tile(n, A, P, C, i0, j0, 0, ilen, jlen, klen);
+    }
+}
+
+/*
+ * TASK 21a
+ *
+ * The symmetric rank-k update C = A * A', computed one triangle at a time:  only
+ * the tiles of C on and below the diagonal, and within each diagonal tile only
+ * the elements on and below its diagonal, about half the FLOPs of a full
+ * multiply.  With `mirror` set, the lower triangle is then copied into the upper
+ * one, for a full (symmetric) C; otherwise C's upper triangle is left as it was.
+ *
+ * A' is never formed in full.  For each k-tile, the bs columns of A it covers are
+ * transposed (with Simd.tr_tile) into a bs x n strip, which then plays the part
+ * of B's k-tile in matmult_bl's tile kernel, for every tile of C on or below the
+ * diagonal.  Diagonal tiles run that kernel on 4-row slices up to the diagonal,
+ * and finish the 4 x 4 triangle on it element by element.  The block size is
+ * `blocksz`, as in matmult_bl (<= 0 selects the tuned size).  If the strip can't
+ * be allocated, each element of the lower triangle is a dot product of two rows
+ * of A instead.
+ *
+ * PRECONDITIONS:  A and C are n x n row-major matrices, and C is initialized to
+ * zero (at least on and below the diagonal).
+ */
+void syrk(int n, int blocksz, bool mirror, double* A, double* C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    int bs = blocksz, n_blocks = (n + bs - 1) / bs;
+    double* P = matrix_alloc((size_t)bs * n * sizeof(double));
+
+    for (int i = 0; !P && i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < n; k++) {
+                sum += A[i * n + k] * A[j * n + k];
+            }
+            C[i * n + j] += sum;
+        }
+    }
+    for (int kk = 0; P && kk < n_blocks; kk++) {
+        int k0 = kk * bs, klen = (k0 + bs < n) ? bs : n - k0;
+        double* Ak = A + k0; // so that column k0 + k of A is column k of Ak
+
+        // P[k][j] = A[j][k0 + k], one bs-row tile of A at a time
+        for (int j0 = 0; j0 < n; j0 += bs) {
+            int jlen = (j0 + bs < n) ? bs : n - j0;
+
+            if (Simd.tr_tile) {
+                Simd.tr_tile(n, Ak, P, j0, 0, jlen, klen);
+            } else {
+                for (int j = j0; j < j0 + jlen; j++) {
+                    for (int k = 0; k < klen; k++) {
+                        P[k * n + j] = Ak[j * n + k];
+                    }
+                }
+            }
+        }
+
+        for (int ii = 0; ii < n_blocks; ii++) {
+            int i0 = ii * bs, ilen = (i0 + bs < n) ? bs : n - i0;
+
+            for (int jj = 0; jj < ii; jj++) {
+                syrk_tile(n, Ak, P, C, i0, jj * bs, ilen, bs, klen);
+            }
+
+            // The diagonal tile:  4-row slices, then the triangle at their right end
+            for (int r = i0; r < i0 + ilen; r += 4) {
+                int rlen = (r + 4 < i0 + ilen) ? 4 : i0 + ilen - r;
+
+                if (r > i0) syrk_tile(n, Ak, P, C, r, i0, rlen, r - i0, klen);
+                for (int i = r; i < r + rlen; i++) {
+                    for (int j = r; j <= i; j++) {
                         double sum = 0.0;
-                        for (int k = k_start; k < k_end; k++) {
-                            sum += A[i * n + k] * B[k * n + j];
+                        for (int k = 0; k < klen; k++) {
+                            sum += Ak[i * n + k] * P[k * n + j];
                         }
                         C[i * n + j] += sum;
                     }
@@ -104,5 +1046,132 @@ void matmult_bl(int n, double* A, double* B, double* C) {
             }
         }
     }
+    matrix_free(P);
+
+    if (mirror) mirror_lower(n, bs, C);
+}
+
+/*
+ * TASK 21b
+ *
+ * Triangular times dense:  C = T * B, where T is lower triangular (or upper, if
+ * `upper` is set).  Only that triangle of T is read; the other is taken to be
+ * zero, whatever it holds.  This is matmult_bl restricted to the k-tiles of T
+ * that aren't all zero, which skips about half the FLOPs and half of T and B.
+ * Those k-tiles run the same kernel as matmult_bl's (Simd.bl_tile, or its
+ * scalar tile); the k-tile on T's diagonal, itself triangular, runs row by row,
+ * as a Simd.axpy of each row of B that the row of T reaches.
+ *
+ * PRECONDITIONS:  T, B and C are n x n row-major matrices. C is initialized to
+ * zero.
+ */
+void trmm(bool upper, int n, int blocksz, double* T, double* B, double* C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+    int bs = blocksz, n_blocks = (n + bs - 1) / bs;
+
+    for (int ii = 0; ii < n_blocks; ii++) {
+        int i0 = ii * bs, ilen = (i0 + bs < n) ? bs : n - i0;
+
+        for (int jj = 0; jj < n_blocks; jj++) {
+            int j0 = jj * bs, jlen = (j0 + bs < n) ? bs : n - j0;
+            int kk_first = upper ? ii : 0, kk_last = upper ? n_blocks - 1 : ii;
+
+            for (int kk = kk_first; kk <= kk_last; kk++) {
+                int k0 = kk * bs, klen = (k0 + bs < n) ? bs : n - k0;
+
+                if (kk == ii) {
+                    for (int i = i0; i < i0 + ilen; i++) {
+                        int k_first = upper ? i : k0, k_end = upper ? k0 + klen : i + 1;
+                        for (int k = k_first; k < k_end; k++) {
+                            Simd.axpy(jlen, T[i * n + k], B + k * n + j0, C + i * n + j0);
+                        }
+                    }
+                } else if (Simd.bl_tile) {
+                    Simd.bl_tile(n, T, B, C, i0, j0, k0, ilen, jlen, klen);
+                } else {
+                    matmult_bl_tile(n, T, B, C, i0, j0, k0, ilen, jlen, klen);
+                }
+            }
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Each unit of work handed to a thread is a run of consecutive matrices worth
+// roughly this many multiply-adds, so that tiny matrices are not scheduled (or
+// stolen) one at a time.
+#define BATCH_CHUNK_WORK (1 << 15)
+
+typedef struct batch_job_t {
+    int count, n, chunk;
+    BatchFn fn;              // Simd.batch[n], or NULL if n > BATCH_MAX
+    double **A, **B, **C;    // matrix pointers, for matmult_batched ...
+    double *As, *Bs, *Cs;    // ... or base and stride, for matmult_batched_strided
+    long stride_a, stride_b, stride_c;
+} BatchJob;
+
+static void matmult_batched_job_tile(void* ctx, int tile) {
+    BatchJob* job = ctx;
+    int first = tile * job->chunk;
+    int last = (first + job->chunk < job->count) ? (first + job->chunk) : job->count;
+    int n = job->n;
+
+    for (int b = first; b < last; b++) {
+        double* A = job->A ? job->A[b] : job->As + b * job->stride_a;
+        double* B = job->B ? job->B[b] : job->Bs + b * job->stride_b;
+        double* C = job->C ? job->C[b] : job->Cs + b * job->stride_c;
+
+        if (job->fn) {
+            job->fn(A, B, C);
+        } else {
+            gemm(false, false, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+        }
+    }
+}
+
+static void matmult_batched_run(BatchJob* job, int nthreads) {
+    long work = (long)job->n * job->n * job->n;
+
+    job->chunk = (work < BATCH_CHUNK_WORK) ? (int)(BATCH_CHUNK_WORK / work) : 1;
+    job->fn = (job->n <= BATCH_MAX) ? Simd.batch[job->n] : NULL;
+    run_tiles_ws(nthreads, (job->count + job->chunk - 1) / job->chunk, matmult_batched_job_tile, job);
+}
+
+/*
+ * TASK 12
+ *
+ * C[b] = A[b] * B[b] for every b in [0, count), where each is an n x n row-major
+ * matrix:  many small multiplies, at a cost per matrix close to the FLOPs alone.
+ * For n <= BATCH_MAX each multiply is a single call to a kernel with n built in
+ * (Simd.batch[n]), fully unrolled and held in registers, so there are no tile
+ * bounds to compute and no short-circuit checks.  Larger n falls back to gemm.
+ * The batch is spread across `nthreads` threads (<= 0 means one per online CPU)
+ * by work stealing, in chunks of consecutive matrices.
+ *
+ * Unlike the single-matrix matmult_* kernels, C[b] is overwritten, so it needn't
+ * be zeroed first.  The same matrix may appear more than once among the A[b] and
+ * B[b], but no C[b] may overlap another matrix in the batch.
+ */
+void matmult_batched(int count, int n, int nthreads, double* A[], double* B[], double* C[]) {
+    if (count <= 0 || n <= 0) return;
+
+    BatchJob job = {.count = count, .n = n, .A = A, .B = B, .C = C};
+    matmult_batched_run(&job, nthreads);
 }
 
+/*
+ * matmult_batched for a batch stored at fixed strides:  matrix b of A starts at
+ * A + b * stride_a, and likewise for B and C (strides counted in doubles).  A
+ * stride of 0 reuses one matrix for the whole batch, e.g. a fixed B.
+ */
+void matmult_batched_strided(int count, int n, int nthreads, double* A, long stride_a, double* B, long stride_b,
+                             double* C, long stride_c) {
+    if (count <= 0 || n <= 0) return;
+
+    BatchJob job = {
+        .count = count, .n = n, .As = A, .Bs = B, .Cs = C,
+        .stride_a = stride_a, .stride_b = stride_b, .stride_c = stride_c,
+    };
+    matmult_batched_run(&job, nthreads);
+}
@@ -2,9 +2,52 @@
 #ifndef TASKS_H
 #define TASKS_H
 
+#include <stdbool.h>
+
+// Register block of matmult_tiled's micro-kernel:  an MM_MR x MM_NR tile of C is
+// held in registers while it accumulates a whole k-panel.
+#define MM_MR 4
+#define MM_NR 8
+
+// matmult_batched has a fully unrolled kernel for every n up to this
+#define BATCH_MAX 32
+
+/*
+ * Cache-level tile sizes for matmult_tiled.  Defaults are set for a 32-48 KB L1,
+ * 1-2 MB L2 and a multi-MB L3, and can be changed at runtime through Tile_Sizes.
+ */
+typedef struct tile_sizes_t {
+    int kc; // L1: depth of a k-panel; a kc x MM_NR sliver of B stays in L1
+    int mc; // L2: rows of A per macro-tile; an mc x kc block of A stays in L2
+    int nc; // L3: columns of B per macro-tile; a kc x nc panel of B stays in L3
+} TileSizes;
+
+extern TileSizes Tile_Sizes;
+
+// matmult_strassen recurses only while the matrix is larger than this.
+extern int Strassen_Crossover;
+
 void matmult(int n, double *A, double *B, double *C);
 void matmult_cm(int n, double *A, double *B, double *C);
 void matmult_li(int n, double *A, double *B, double *C);
-void matmult_bl(int n, double *A, double *B, double *C);
+void matmult_bl(int n, int blocksz, double *A, double *B, double *C);
+void matmult_bl_mt(int n, int blocksz, int nthreads, double *A, double *B, double *C);
+void matmult_bl_ws(int n, int blocksz, int nthreads, double *A, double *B, double *C);
+void matmult_bl_ctile_at(int n, int blocksz, double *A, double *B, double *C, int ii, int jj);
+void matmult_tiled(int n, double *A, double *B, double *C);
+void matmult_packed(int n, double *A, double *B, double *C);
+void matmult_fused(int n, int nthreads, double *A, double *B, double *C);
+void matmult_rec(int n, double *A, double *B, double *C);
+void matmult_strassen(int n, double *A, double *B, double *C);
+
+void matmult_batched(int count, int n, int nthreads, double *A[], double *B[], double *C[]);
+void matmult_batched_strided(int count, int n, int nthreads, double *A, long stride_a, double *B, long stride_b,
+                             double *C, long stride_c);
+
+void gemm(bool trans_a, bool trans_b, int m, int n, int k, double alpha, double *A, int lda, double *B, int ldb,
+          double beta, double *C, int ldc);
+
+void syrk(int n, int blocksz, bool mirror, double *A, double *C);
+void trmm(bool upper, int n, int blocksz, double *T, double *B, double *C);
 
 #endif
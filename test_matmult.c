@@ -1,25 +1,69 @@
 #include <assert.h>
+#include <float.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#include "alloc.h"
+#include "csr.h"
 #include "helpers.h"
+#include "jobs.h"
+#include "layout.h"
+#include "ooc.h"
+#include "simd.h"
 #include "tasks.h"
+#include "threads.h"
+#include "tune.h"
+
+// Matrices per batch in the matmult_batched test
+#define BATCH_COUNT 5
+
+/*
+ * The reference for gemm:  C = alpha * op(A) * op(B) + beta * C, the obvious way.
+ */
+static void gemm_ref(bool ta, bool tb, int m, int n, int k, double alpha, double *A, int lda, double *B, int ldb,
+                     double beta, double *C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int p = 0; p < k; p++) {
+                sum += (ta ? A[p * lda + i] : A[i * lda + p]) * (tb ? B[j * ldb + p] : B[p * ldb + j]);
+            }
+            C[i * ldc + j] = alpha * sum + (beta == 0.0 ? 0.0 : beta * C[i * ldc + j]);
+        }
+    }
+} // gemm_ref
+
+/*
+ * "<level> <kernel>", to label one line of the SIMD comparison.  The result is
+ * in a static buffer, good until the next call.
+ */
+static const char *label(SimdLevel l, const char *kernel) {
+    static char buf[32];
+
+    snprintf(buf, sizeof(buf), "%-7s %s", simd_name(l), kernel);
+    return buf;
+} // label
 
 int main(int argc, char **argv) {
     double *A, *B, *C;
 
-    int n = get_arg(argc, argv);
+    // Block sizes left out (and the cache tiles) are the built-in ones, whatever
+    // this host's tuning profile says
+    tune_reset();
+
+    bool passed = true; // every check below, for the exit status
+    Args args = get_args(argc, argv);
+    int n = args.n;
 
     A = make_one_matrix(n);
     B = make_one_matrix(n);
     C = make_one_matrix(n);
 
-    double *B_t = make_one_matrix(n);
-    zero(n, B_t);
-    transpose(n, B, B_t);
-    // Use B_t one for the versions that assume a realigned multiplicand
 
     zero(n, C);
     matmult(n, A, B, C);
@@ -27,12 +71,21 @@ int main(int argc, char **argv) {
     printf("Testing calculation of A*B = C, for %d x %d matrices A and B\n", n, n);
     print_matrix_product(n, A, B, C);
 
+    // The naive product is the reference for every kernel below.  (Exact, since
+    // the test matrices hold small integers.)
+    double *R = make_one_matrix(n);
+    memcpy(R, C, (size_t)n * n * sizeof(double));
+
     printf("\n----------------------------\n");
     printf("With column-major realignment (no blocking):\n");
 
+    // Realign B in place for matmult_cm, then put it back for the other versions
+    transpose_inplace(n, B);
     zero(n, C);
-    matmult_cm(n, A, B_t, C);
+    matmult_cm(n, A, B, C);
     print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("column-major vs. naive", n, R, C, 0.0);
+    transpose_inplace(n, B);
 
     printf("\n----------------------------\n");
     printf("With loop interchange (no blocking):\n");
@@ -40,15 +93,453 @@ int main(int argc, char **argv) {
     zero(n, C);
     matmult_li(n, A, B, C);
     print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("interchange vs. naive", n, R, C, 0.0);
 
     printf("\n--------------------------------------------------------\n");
-    printf("BLOCK SIZE = %d\n", BLOCKSZ);
+    printf("BLOCK SIZE = %d\n", args.blocksz);
     printf("\n----------------------------\n");
     printf("With blocking (%sshortcircuit):\n", (SHORT_CIRCUIT ? "" : "no "));
 
     zero(n, C);
-    matmult_bl(n, A, B, C);
+    matmult_bl(n, args.blocksz, A, B, C);
     print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("blocked vs. naive", n, R, C, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("With blocking, multithreaded (%d threads):\n", num_threads(args.threads));
+
+    zero(n, C);
+    matmult_bl_mt(n, args.blocksz, args.threads, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("blocked (mt) vs. naive", n, R, C, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("With blocking, work-stealing (%d threads):\n", num_threads(args.threads));
+
+    zero(n, C);
+    matmult_bl_ws(n, args.blocksz, args.threads, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("blocked (ws) vs. naive", n, R, C, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("With multi-level tiling (%dx%d micro-kernel, kc=%d, mc=%d, nc=%d):\n", MM_MR, MM_NR,
+           Tile_Sizes.kc, Tile_Sizes.mc, Tile_Sizes.nc);
+
+    zero(n, C);
+    matmult_tiled(n, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("tiled vs. naive", n, R, C, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("With multi-level tiling and packed panels:\n");
+
+    zero(n, C);
+    matmult_packed(n, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("packed vs. naive", n, R, C, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("Cache-oblivious (recursive):\n");
+
+    zero(n, C);
+    matmult_rec(n, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("recursive vs. naive", n, R, C, 0.0);
+
+    // A tiny crossover, so that even small test matrices exercise the recursion
+    // (and the zero padding, when n isn't a power of two).
+    Strassen_Crossover = 2;
+
+    printf("\n----------------------------\n");
+    printf("Strassen-Winograd (crossover = %d):\n", Strassen_Crossover);
+
+    zero(n, C);
+    matmult_strassen(n, A, B, C);
+    print_one_matrix(n, C, true);
+    passed &= print_matrix_compare("strassen vs. naive", n, R, C, 0.0);
+
+    // Every kernel, at every instruction-set level this CPU supports, against the
+    // naive result.
+    void (*kernels[])(int, double *, double *, double *) = {matmult_li, matmult_tiled, matmult_packed,
+                                                            matmult_rec, matmult_strassen};
+    const char *names[] = {"interchange", "tiled", "packed", "recursive", "strassen"};
+    SimdLevel best = Simd.level;
+
+    // The tile-major kernel runs on copies of A and B, in tiles that don't divide n
+    // (unless -b gives a size), and its result is converted back for the comparison.
+    int tl_bs = ragged_block(args, n);
+    double *LA = make_tiled_matrix(n, tl_bs), *LB = make_tiled_matrix(n, tl_bs);
+    double *LC = make_tiled_matrix(n, tl_bs);
+
+    to_tiled(n, tl_bs, A, LA);
+    to_tiled(n, tl_bs, B, LB);
+
+    printf("\n----------------------------\n");
+    printf("SIMD kernels vs. naive (selected at startup: %s):\n", Simd.name);
+    for (SimdLevel l = SIMD_SCALAR; l < SIMD_LEVELS; l++) {
+        if (!simd_select(l)) {
+            printf("  %-7s (not supported on this CPU)\n", simd_name(l));
+            continue;
+        }
+        for (int v = 0; v < 9; v++) {
+            zero(n, C);
+            if (v < 5) {
+                kernels[v](n, A, B, C);
+            } else if (v == 5) {
+                matmult_bl(n, args.blocksz, A, B, C);
+            } else if (v == 6) {
+                matmult_bl_ws(n, args.blocksz, args.threads, A, B, C);
+            } else if (v == 7) {
+                // Cache tiles that leave ragged slices and panels even at small n
+                TileSizes saved = Tile_Sizes;
+                Tile_Sizes = (TileSizes){.kc = 5, .mc = 6, .nc = 12};
+                matmult_fused(n, args.threads, A, B, C);
+                Tile_Sizes = saved;
+            } else {
+                memset(LC, 0, tiled_count(n, tl_bs) * sizeof(double));
+                matmult_tl(n, tl_bs, LA, LB, LC);
+                from_tiled(n, tl_bs, LC, C);
+            }
+            const char *name = (v < 5 ? names[v] : v == 5 ? "blocked" : v == 6 ? "blocked (ws)"
+                                : v == 7 ? "fused" : "tile-major");
+            passed &= print_matrix_compare(label(l, name), n, R, C, 0.0);
+        }
+    }
+    simd_select(best);
+    matrix_free(LA);
+    matrix_free(LB);
+    matrix_free(LC);
+
+    // The typed blocked multiplies at every instruction-set level, on values small
+    // enough that every element type holds them, and their products, exactly.
+    double *S = malloc(n * n * sizeof(double));
+    double *SR = calloc(n * n, sizeof(double));
+    double *SW = malloc(n * n * sizeof(double));
+
+    for (int i = 0; i < n * n; i++) {
+        S[i] = (double)(i % 7 - 3);
+    }
+    matmult(n, S, S, SR);
+
+    printf("\n----------------------------\n");
+    printf("Typed blocked multiplies vs. naive:\n");
+    for (SimdLevel l = SIMD_SCALAR; l < SIMD_LEVELS; l++) {
+        if (!simd_select(l)) continue;
+
+        for (ElemType t = ELEM_F64; t < ELEM_TYPES; t++) {
+            void *TA = make_typed_matrix(t, false, n, S);
+            void *TC = make_typed_matrix(t, true, n, NULL);
+
+            matmult_bl_typed(t, n, args.blocksz, TA, TA, TC);
+            typed_to_double(t, true, n, TC, SW);
+            passed &= print_matrix_compare(label(l, elem_name(t)), n, SR, SW, 0.0);
+            matrix_free(TA);
+            matrix_free(TC);
+        }
+    }
+    simd_select(best);
+    free(S);
+    free(SR);
+    free(SW);
+
+    // matmult_batched at every instruction-set level, for every unrolled size and
+    // the first size past them (the gemm fallback):  a batch of BATCH_COUNT
+    // distinct matrices, each checked against matmult.
+    printf("\n----------------------------\n");
+    printf("matmult_batched, n = 1..%d, vs. naive:\n", BATCH_MAX + 1);
+    for (SimdLevel l = SIMD_SCALAR; l < SIMD_LEVELS; l++) {
+        if (!simd_select(l)) continue;
+
+        MatrixDiff worst = {.ok = true};
+        for (int bn = 1; bn <= BATCH_MAX + 1; bn++) {
+            int sz = bn * bn;
+            double *As = malloc(BATCH_COUNT * sz * sizeof(double));
+            double *Bs = malloc(BATCH_COUNT * sz * sizeof(double));
+            double *Cs = malloc(BATCH_COUNT * sz * sizeof(double));
+            double *Ap[BATCH_COUNT], *Bp[BATCH_COUNT], *Cp[BATCH_COUNT];
+
+            for (int i = 0; i < BATCH_COUNT * sz; i++) {
+                As[i] = (double)(i % 7 - 3);
+                Bs[i] = (double)(i % 5 - 2);
+                Cs[i] = NAN; // overwritten, never read
+            }
+            // Pointers in reverse order, so the two entry points index differently
+            for (int b = 0; b < BATCH_COUNT; b++) {
+                Ap[b] = As + (BATCH_COUNT - 1 - b) * sz;
+                Bp[b] = Bs + (BATCH_COUNT - 1 - b) * sz;
+                Cp[b] = Cs + (BATCH_COUNT - 1 - b) * sz;
+            }
+            matmult_batched(BATCH_COUNT, bn, args.threads, Ap, Bp, Cp);
+            for (int v = 0; v < 2; v++) {
+                for (int b = 0; b < BATCH_COUNT; b++) {
+                    double *Rb = calloc(sz, sizeof(double));
+
+                    matmult(bn, As + b * sz, Bs + b * sz, Rb);
+                    MatrixDiff md = matrix_compare(bn, Rb, Cs + b * sz, 0.0);
+                    if (md.max_ulp > worst.max_ulp) worst.max_ulp = md.max_ulp;
+                    if (!(md.max_rel <= worst.max_rel)) worst.max_rel = md.max_rel;
+                    worst.ok = worst.ok && md.ok;
+                    free(Rb);
+                }
+                for (int i = 0; i < BATCH_COUNT * sz; i++) {
+                    Cs[i] = NAN;
+                }
+                if (v == 0) matmult_batched_strided(BATCH_COUNT, bn, args.threads, As, sz, Bs, sz, Cs, sz);
+            }
+            free(As);
+            free(Bs);
+            free(Cs);
+        }
+        passed &= print_matrix_diff(label(l, "batched"), worst);
+    }
+    simd_select(best);
+
+    // gemm on rectangular sub-blocks of the n x n matrices (so every leading
+    // dimension is n), in all four transpose combinations.  alpha and beta are
+    // powers of two, so the results are still exact.
+    int m = n - n / 3, nn = n - n / 4, k = n - n / 2;
+    double *D = make_one_matrix(n);
+
+    printf("\n----------------------------\n");
+    printf("gemm on %d x %d x %d sub-blocks (ld = %d) vs. reference:\n", m, nn, k, n);
+    for (int t = 0; t < 4; t++) {
+        bool ta = t & 1, tb = t & 2;
+        // op(A) is m x k, so A itself is k x m when transposed; likewise for B.
+        double *Ab = A + (n - (ta ? k : m)) * n, *Bb = B + (n - (tb ? nn : k));
+        for (int i = 0; i < n * n; i++) {
+            C[i] = D[i] = R[i];
+        }
+        gemm(ta, tb, m, nn, k, 0.5, Ab, n, Bb, n, 2.0, C + (n - m) * n + (n - nn), n);
+        gemm_ref(ta, tb, m, nn, k, 0.5, Ab, n, Bb, n, 2.0, D + (n - m) * n + (n - nn), n);
+        char op[32];
+
+        snprintf(op, sizeof(op), "op(A) = %s  op(B) = %s", (ta ? "A'" : "A "), (tb ? "B'" : "B "));
+        passed &= print_matrix_compare(op, n, D, C, 0.0);
+    }
+    // beta = 0 must ignore C's old contents entirely, even NaNs.
+    for (int i = 0; i < n * n; i++) {
+        C[i] = NAN;
+    }
+    gemm(false, false, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+    passed &= print_matrix_compare("beta = 0 over NaN", n, R, C, 0.0);
+
+    // syrk against A * A' from matmult, both mirrored and as the lower triangle
+    // alone; trmm against matmult on a copy of A with the other triangle zeroed.
+    // Block sizes that don't divide n (unless -b gives one) reach the ragged tiles.
+    int st_bs = ragged_block(args, n);
+    double *At = make_one_matrix(n), *Tz = make_one_matrix(n);
+
+    transpose(n, A, At);
+    zero(n, D);
+    matmult(n, A, At, D);
+
+    printf("\n----------------------------\n");
+    printf("Symmetric and triangular kernels (block size = %d) vs. naive:\n", st_bs);
+    for (SimdLevel l = SIMD_SCALAR; l < SIMD_LEVELS; l++) {
+        if (!simd_select(l)) continue;
+
+        zero(n, C);
+        syrk(n, st_bs, true, A, C);
+        passed &= print_matrix_compare(label(l, "syrk"), n, D, C, 0.0);
+
+        zero(n, C);
+        syrk(n, st_bs, false, A, C);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                Tz[i * n + j] = (j <= i ? D[i * n + j] : 0.0);
+            }
+        }
+        passed &= print_matrix_compare(label(l, "syrk (lower)"), n, Tz, C, 0.0);
+
+        for (int upper = 0; upper < 2; upper++) {
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < n; j++) {
+                    Tz[i * n + j] = ((upper ? j >= i : j <= i) ? A[i * n + j] : 0.0);
+                }
+            }
+            zero(n, R);
+            matmult(n, Tz, B, R);
+            zero(n, C);
+            trmm(upper, n, st_bs, A, B, C);
+            passed &= print_matrix_compare(label(l, (upper ? "trmm (upper)" : "trmm (lower)")), n, R, C, 0.0);
+        }
+    }
+    simd_select(best);
+    matrix_free(At);
+    matrix_free(Tz);
+
+    // R is A * B again, for the tests below
+    zero(n, R);
+    matmult(n, A, B, R);
+
+    // The sparse multiplies, on a copy of A with about two elements in three zeroed
+    // (and a BSR block size that doesn't divide n, unless -b gives one), against
+    // matmult on the same dense matrix.  The round trips to dense must be exact too.
+    int sp_bs = ragged_block(args, n);
+    double *Sp = make_one_matrix(n);
+    CsrMatrix SC;
+    BsrMatrix SB;
+
+    for (int i = 0; i < n * n; i++) {
+        if (i % 3) Sp[i] = 0.0;
+    }
+    zero(n, D);
+    matmult(n, Sp, B, D);
+    csr_from_dense(n, Sp, &SC);
+    bsr_from_dense(n, sp_bs, Sp, &SB);
+
+    printf("\n----------------------------\n");
+    printf("Sparse multiplies (%ld nonzeros, BSR block = %d) vs. naive:\n", SC.nnz, sp_bs);
+    for (int v = 0; v < 6; v++) {
+        const char *sp_names[] = {"csr round trip", "bsr round trip", "spmm_csr", "spmm_csr_mt", "spmm_bsr",
+                                  "spmm_bsr_mt"};
+
+        zero(n, C);
+        switch (v) {
+        case 0: csr_to_dense(&SC, C); break;
+        case 1: bsr_to_dense(&SB, C); break;
+        case 2: spmm_csr(&SC, 3, B, C); break;
+        case 3: spmm_csr_mt(&SC, 0, args.threads, B, C); break;
+        case 4: spmm_bsr(&SB, 3, B, C); break;
+        default: spmm_bsr_mt(&SB, 0, args.threads, B, C); break;
+        }
+        passed &= print_matrix_compare(sp_names[v], n, (v < 2 ? Sp : D), C, 0.0);
+    }
+    csr_free(&SC);
+    bsr_free(&SB);
+    matrix_free(Sp);
+
+    // The job API:  every batched size up to n (on the leading elements of A and
+    // B), the n x n multiply (in items of several tiles, then in one item per
+    // 1 x 1 tile) and its transpose, all outstanding at once, with C full of NaNs
+    // since every job overwrites it.
+    int small = (n < BATCH_MAX ? n : BATCH_MAX), jobs = small + 3;
+    MmHandle *handles = malloc(jobs * sizeof(MmHandle));
+    double **Js = malloc(jobs * sizeof(double *));
+    bool jobs_ok = true;
+
+    mm_pool_start(args.threads);
+    for (int q = 0; q < jobs; q++) {
+        int jn = (q < small ? q + 1 : n);
+        MmJob job = {.op = (q == small + 2 ? MM_TRANSPOSE : MM_MATMULT), .n = jn,
+                     .blocksz = (q == small + 1 ? 1 : st_bs), .A = A, .B = B};
+
+        Js[q] = job.C = malloc((size_t)jn * jn * sizeof(double));
+        for (int i = 0; i < jn * jn; i++) {
+            Js[q][i] = NAN;
+        }
+        handles[q] = mm_submit(job);
+    }
+    for (int q = jobs - 1; q >= 0; q--) {
+        int jn = (q < small ? q + 1 : n);
+
+        mm_wait(handles[q]);
+        zero(jn, D);
+        if (q == small + 2) {
+            transpose(n, A, D);
+        } else {
+            matmult(jn, A, B, D);
+        }
+        jobs_ok = jobs_ok && matrix_compare(jn, D, Js[q], 0.0).ok;
+        free(Js[q]);
+    }
+    // An empty job is done as soon as it is submitted
+    MmHandle empty = mm_submit((MmJob){.op = MM_MATMULT, .n = 0});
+    jobs_ok = jobs_ok && mm_test(empty);
+    mm_wait(empty);
+    mm_pool_stop();
+    free(handles);
+    free(Js);
+
+    printf("\n----------------------------\n");
+    printf("Job API (%d jobs in flight) vs. naive:  %s\n", jobs, (jobs_ok ? "PASS" : "FAIL"));
+    passed &= jobs_ok;
+
+    // Out of core, through temporary files, in tiles that don't divide n (unless -b
+    // gives a size)
+    char path_a[] = "/tmp/test_matmult_a_XXXXXX", path_b[] = "/tmp/test_matmult_b_XXXXXX";
+    char path_c[] = "/tmp/test_matmult_c_XXXXXX";
+    OocMatrix FA, FB, FC;
+    long tile = ragged_block(args, n);
+
+    close(mkstemp(path_a));
+    close(mkstemp(path_b));
+    close(mkstemp(path_c));
+    ooc_create(&FA, path_a, ELEM_F64, n, n, tile);
+    ooc_create(&FB, path_b, ELEM_F64, n, n, tile);
+    ooc_create(&FC, path_c, ELEM_F64, n, n, tile);
+    ooc_store(&FA, A);
+    ooc_store(&FB, B);
+    ooc_matmult(&FA, &FB, &FC);
+    ooc_load(&FC, C);
+
+    printf("\n----------------------------\n");
+    printf("Out-of-core matmult (tile = %ld):\n", tile);
+    passed &= print_matrix_compare("out-of-core vs. naive", n, R, C, 0.0);
+    ooc_close(&FA);
+    ooc_close(&FB);
+    ooc_close(&FC);
+    unlink(path_a);
+    unlink(path_b);
+    unlink(path_c);
+
+    // A tuning profile survives a save and load, and resolves block sizes by n
+    char path_p[] = "/tmp/test_matmult_profile_XXXXXX";
+    TuneProfile P, Q;
+
+    memset(&P, 0, sizeof(P)); // padding too, for the memcmp below
+    close(mkstemp(path_p));
+    tune_set(&P, TUNE_MATMULT_BL, 512, 64);
+    tune_set(&P, TUNE_MATMULT_BL, 128, 32);
+    tune_set(&P, TUNE_TRANSPOSE_BL, 256, 16);
+    P.have_tiles = true;
+    P.tiles = (TileSizes){.kc = 192, .mc = 72, .nc = 1024};
+    bool ok = !tune_save(path_p, &P) && !tune_load(path_p, &Q) && !memcmp(&P, &Q, sizeof(P));
+
+    TuneProfile saved = Tune_Profile;
+    TileSizes saved_tiles = Tile_Sizes;
+    tune_apply(&Q);
+    ok = ok && tune_block(TUNE_MATMULT_BL, 100) == 32 && tune_block(TUNE_MATMULT_BL, 200) == 64 &&
+         tune_block(TUNE_MATMULT_BL, 4096) == 64 && tune_block(TUNE_TRANSPOSE_BL, 8) == 16 && Tile_Sizes.kc == 192;
+    Tune_Profile = saved;
+    Tile_Sizes = saved_tiles;
+    unlink(path_p);
+
+    printf("\n----------------------------\n");
+    printf("Tuning profile round trip:  %s\n", (ok ? "PASS" : "FAIL"));
+    passed &= ok;
+
+    // The fills and matrix_compare, on a matrix big enough for several ranges and
+    // non-temporal stores, whatever n is.  One ulp apart passes only with a
+    // tolerance, and a NaN never does.
+    int fn = 2048;
+    double *F = make_one_matrix(fn), *G = make_one_matrix(fn);
+
+    ok = true;
+    for (long i = 0; i < (long)fn * fn; i += 4099) {
+        ok = ok && F[i] == (double)(i + 1);
+    }
+    ok = ok && F[(long)fn * fn - 1] == (double)fn * fn && matrix_compare(fn, F, G, 0.0).ok;
+    G[fn * 7 + 3] = nextafter(G[fn * 7 + 3], INFINITY);
+    MatrixDiff md = matrix_compare(fn, F, G, 0.0);
+    ok = ok && md.max_ulp == 1 && !md.ok && matrix_compare(fn, F, G, 4 * DBL_EPSILON).ok;
+    G[fn * 9] = NAN;
+    ok = ok && !matrix_compare(fn, F, G, 1.0).ok;
+    fill(fn, F, -2.5);
+    zero(fn - 1, G + 1);
+    ok = ok && F[0] == -2.5 && F[(long)fn * fn - 1] == -2.5 && G[0] == 1.0 && G[1] == 0.0 &&
+         G[(long)(fn - 1) * (fn - 1)] == 0.0 && G[(long)(fn - 1) * (fn - 1) + 1] != 0.0;
+    matrix_free(F);
+    matrix_free(G);
+
+    printf("\n----------------------------\n");
+    printf("Fills and matrix_compare:  %s\n", (ok ? "PASS" : "FAIL"));
+    passed &= ok;
 
-    return 0;
+    matrix_free(A);
+    matrix_free(B);
+    matrix_free(C);
+    matrix_free(R);
+    matrix_free(D);
+    return passed ? 0 : 1;
 } // main
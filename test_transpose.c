@@ -2,14 +2,40 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#include "alloc.h"
+#include "csr.h"
 #include "helpers.h"
+#include "layout.h"
+#include "ooc.h"
+#include "simd.h"
+#include "threads.h"
+#include "tune.h"
+
+/*
+ * "<level> <kernel>", to label one line of the SIMD comparison.  The result is
+ * in a static buffer, good until the next call.
+ */
+static const char *label(SimdLevel l, const char *kernel) {
+    static char buf[32];
+
+    snprintf(buf, sizeof(buf), "%-7s %s", simd_name(l), kernel);
+    return buf;
+} // label
 
 int main(int argc, char **argv) {
     double *M, *M_t;
 
-    int n = get_arg(argc, argv);
+    // Block sizes left out (and the cache tiles) are the built-in ones, whatever
+    // this host's tuning profile says
+    tune_reset();
+
+    bool passed = true; // every check below, for the exit status
+    Args args = get_args(argc, argv);
+    int n = args.n;
 
     M = make_one_matrix(n);
     M_t = make_one_matrix(n);
@@ -22,12 +48,170 @@ int main(int argc, char **argv) {
     printf("\nM_t:\n");
     print_one_matrix(n, M_t, true);
 
+    // The naive transpose is the reference for every kernel below
+    double *R = make_one_matrix(n);
+    memcpy(R, M_t, (size_t)n * n * sizeof(double));
+
+    printf("\n----------------------------\n");
+    printf("With blocking (block size=%d,%sshortcircuit):\n", args.blocksz, (SHORT_CIRCUIT ? "" : "no "));
+    zero(n, M_t);
+
+    transpose_bl(n, args.blocksz, M, M_t);
+    print_one_matrix(n, M_t, true);
+    passed &= print_matrix_compare("blocked vs. naive", n, R, M_t, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("With blocking, work-stealing (block size=%d, %d threads):\n", args.blocksz, num_threads(args.threads));
+    zero(n, M_t);
+
+    transpose_bl_ws(n, args.blocksz, args.threads, M, M_t);
+    print_one_matrix(n, M_t, true);
+    passed &= print_matrix_compare("blocked (ws) vs. naive", n, R, M_t, 0.0);
+
     printf("\n----------------------------\n");
-    printf("With blocking (block size=%d,%sshortcircuit):\n", BLOCKSZ, (SHORT_CIRCUIT ? "" : "no "));
+    printf("Cache-oblivious, in-register transposes (%s):\n", Simd.name);
     zero(n, M_t);
 
-    transpose_bl(n, M, M_t);
+    transpose_rec(n, M, M_t);
     print_one_matrix(n, M_t, true);
+    passed &= print_matrix_compare("recursive vs. naive", n, R, M_t, 0.0);
+
+    printf("\n----------------------------\n");
+    printf("In place, on a copy of M:\n");
+    double *M_ip = make_one_matrix(n);
+
+    transpose_inplace(n, M_ip);
+    print_one_matrix(n, M_ip, true);
+    passed &= print_matrix_compare("in-place vs. naive", n, R, M_ip, 0.0);
+
+    // All the SIMD-backed transposes, at every instruction-set level this CPU supports,
+    // against the naive result.  The tile-major one runs on a tiled copy of M, in tiles
+    // that don't divide n (unless -b gives a size), and is converted back to compare.
+    SimdLevel best = Simd.level;
+
+    int tl_bs = ragged_block(args, n);
+    double *L = make_tiled_matrix(n, tl_bs), *L_t = make_tiled_matrix(n, tl_bs);
+    to_tiled(n, tl_bs, M, L);
+
+    printf("\n----------------------------\n");
+    printf("SIMD kernels vs. naive (selected at startup: %s):\n", Simd.name);
+    for (SimdLevel l = SIMD_SCALAR; l < SIMD_LEVELS; l++) {
+        if (!simd_select(l)) {
+            printf("  %-7s (not supported on this CPU)\n", simd_name(l));
+            continue;
+        }
+        zero(n, M_t);
+        transpose_bl(n, args.blocksz, M, M_t);
+        passed &= print_matrix_compare(label(l, "blocked"), n, R, M_t, 0.0);
+
+        zero(n, M_t);
+        transpose_rec(n, M, M_t);
+        passed &= print_matrix_compare(label(l, "recursive"), n, R, M_t, 0.0);
+
+        memcpy(M_ip, M, n * n * sizeof(double));
+        transpose_inplace(n, M_ip);
+        passed &= print_matrix_compare(label(l, "in-place"), n, R, M_ip, 0.0);
+
+        memcpy(M_ip, M, n * n * sizeof(double));
+        transpose_inplace_mt(n, args.threads, M_ip);
+        passed &= print_matrix_compare(label(l, "in-place (mt)"), n, R, M_ip, 0.0);
+
+        zero(n, M_t);
+        transpose_tl(n, tl_bs, L, L_t);
+        from_tiled(n, tl_bs, L_t, M_t);
+        passed &= print_matrix_compare(label(l, "tile-major"), n, R, M_t, 0.0);
+    }
+    simd_select(best);
+    matrix_free(L);
+    matrix_free(L_t);
+
+    // The typed transposes, on values that every element type holds exactly
+    double *S = malloc(n * n * sizeof(double));
+    double *S_t = malloc(n * n * sizeof(double));
+    double *SW = malloc(n * n * sizeof(double));
+
+    for (int i = 0; i < n * n; i++) {
+        S[i] = (double)(i % 101 - 50);
+    }
+    transpose(n, S, S_t);
+
+    printf("\n----------------------------\n");
+    printf("Typed blocked transposes vs. naive:\n");
+    for (ElemType t = ELEM_F64; t < ELEM_TYPES; t++) {
+        void *T = make_typed_matrix(t, false, n, S);
+        void *T_t = make_typed_matrix(t, false, n, NULL);
+
+        transpose_bl_typed(t, n, args.blocksz, T, T_t);
+        typed_to_double(t, false, n, T_t, SW);
+        passed &= print_matrix_compare(elem_name(t), n, S_t, SW, 0.0);
+        matrix_free(T);
+        matrix_free(T_t);
+    }
+    free(S);
+    free(S_t);
+    free(SW);
+
+    // The sparse transposes, on a copy of M with about two elements in three zeroed
+    // (and a BSR block size that doesn't divide n, unless -b gives one), converted
+    // back to dense to compare with the naive transpose of the same matrix.
+    int sp_bs = ragged_block(args, n);
+    double *Sp = make_one_matrix(n), *Sp_t = make_one_matrix(n);
+    CsrMatrix SC, SC_t;
+    BsrMatrix SB, SB_t;
+
+    for (int i = 0; i < n * n; i++) {
+        if (i % 3) Sp[i] = 0.0;
+    }
+    transpose(n, Sp, Sp_t);
+    csr_from_dense(n, Sp, &SC);
+    bsr_from_dense(n, sp_bs, Sp, &SB);
+    csr_transpose(&SC, &SC_t);
+    bsr_transpose(&SB, &SB_t);
+
+    printf("\n----------------------------\n");
+    printf("Sparse transposes (%ld nonzeros, BSR block = %d) vs. naive:\n", SC.nnz, sp_bs);
+    csr_to_dense(&SC_t, M_t);
+    passed &= print_matrix_compare("csr_transpose", n, Sp_t, M_t, 0.0);
+    bsr_to_dense(&SB_t, M_t);
+    passed &= print_matrix_compare("bsr_transpose", n, Sp_t, M_t, 0.0);
+    csr_free(&SC);
+    csr_free(&SC_t);
+    bsr_free(&SB);
+    bsr_free(&SB_t);
+    matrix_free(Sp);
+    matrix_free(Sp_t);
+
+    // Out of core, through temporary files, in tiles that don't divide n unless -b
+    // gives a size (so the edge tiles are padded), and a round trip through the file
+    // format.
+    char path[] = "/tmp/test_transpose_XXXXXX", path_t[] = "/tmp/test_transpose_t_XXXXXX";
+    OocMatrix F, F_t;
+    long tile = ragged_block(args, n);
+
+    close(mkstemp(path));
+    close(mkstemp(path_t));
+    ooc_create(&F, path, ELEM_F64, n, n, tile);
+    ooc_store(&F, M);
+    ooc_close(&F);
+    ooc_open(&F, path, false);
+    ooc_create(&F_t, path_t, ELEM_F64, n, n, tile);
+    ooc_transpose(&F, &F_t);
+    ooc_close(&F_t);
+    ooc_open(&F_t, path_t, false);
+    zero(n, M_t);
+    ooc_load(&F_t, M_t);
+
+    printf("\n----------------------------\n");
+    printf("Out-of-core transpose (tile = %ld):\n", tile);
+    passed &= print_matrix_compare("out-of-core vs. naive", n, R, M_t, 0.0);
+    ooc_close(&F);
+    ooc_close(&F_t);
+    unlink(path);
+    unlink(path_t);
 
-    return 0;
+    matrix_free(M);
+    matrix_free(M_t);
+    matrix_free(M_ip);
+    matrix_free(R);
+    return passed ? 0 : 1;
 } // main
@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "placement.h"
+#include "threads.h"
+
+/*
+ * Resolves a requested thread count:  a positive value is used as given, and
+ * anything else means one thread per online CPU.
+ */
+int num_threads(int requested) {
+    if (requested > 0) return requested;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+} // num_threads
+
+typedef struct static_worker_t {
+    TileFn fn;
+    void *ctx;
+    int id, nworkers;
+    int first; // first tile owned by this worker
+    int last;  // one past the last tile owned by this worker
+} StaticWorker;
+
+static void *static_worker(void *arg) {
+    StaticWorker *w = arg;
+
+    if (w->id) numa_pin(w->id, w->nworkers, NULL);
+    for (int t = w->first; t < w->last; t++) {
+        w->fn(w->ctx, t);
+    }
+    return NULL;
+} // static_worker
+
+/*
+ * Runs fn(ctx, t) for every tile t in [0, ntiles), split across nthreads pthreads
+ * (see num_threads) in contiguous, equal-sized ranges.  Each tile runs on exactly
+ * one thread.  The calling thread takes the first range itself, and the call returns
+ * once every tile is done.  Under Numa_Placement every thread is pinned to its CPU
+ * (the calling thread only until the call returns).
+ */
+void run_tiles_static(int nthreads, int ntiles, TileFn fn, void *ctx) {
+    nthreads = num_threads(nthreads);
+    if (nthreads > ntiles) nthreads = ntiles;
+    if (nthreads <= 1) {
+        for (int t = 0; t < ntiles; t++) {
+            fn(ctx, t);
+        }
+        return;
+    }
+
+    pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+    StaticWorker *workers = malloc(nthreads * sizeof(StaticWorker));
+
+    for (int i = 0; i < nthreads; i++) {
+        workers[i] = (StaticWorker){
+            .fn = fn,
+            .ctx = ctx,
+            .id = i,
+            .nworkers = nthreads,
+            .first = (int)((long)ntiles * i / nthreads),
+            .last = (int)((long)ntiles * (i + 1) / nthreads),
+        };
+    }
+    for (int i = 1; i < nthreads; i++) {
+        pthread_create(&tids[i], NULL, static_worker, &workers[i]);
+    }
+    cpu_set_t saved;
+    bool pinned = numa_pin(0, nthreads, &saved);
+    static_worker(&workers[0]);
+    if (pinned) numa_unpin(&saved);
+    for (int i = 1; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    free(workers);
+    free(tids);
+} // run_tiles_static
+
+/////////////////////////////////////////////////////////////////////////
+/*
+ * Work stealing.  Every worker owns a deque of tile numbers.  Tiles are only ever
+ * handed out, never created, so a deque is always a contiguous range
+ * [head, tail) and fits in one 64-bit word (head in the low half, tail in the
+ * high half) that is updated with compare-and-swap.  The owner takes tiles from
+ * the head, one at a time, and so walks its range in order.  An idle worker
+ * steals the back half of a victim's remaining range, which keeps the stolen
+ * tiles contiguous too.
+ */
+typedef struct ws_deque_t {
+    _Atomic uint64_t range;
+    char pad[64 - sizeof(uint64_t)]; // one deque per cache line
+} WsDeque;
+
+typedef struct ws_pool_t {
+    TileFn fn;
+    void *ctx;
+    int nworkers;
+    WsDeque *deques;
+} WsPool;
+
+typedef struct ws_worker_t {
+    WsPool *pool;
+    int id;
+} WsWorker;
+
+static uint64_t ws_pack(uint32_t head, uint32_t tail) {
+    return ((uint64_t)tail << 32) | head;
+}
+
+/*
+ * Takes the tile at the head of d, storing it in *tile.  Returns false if d is
+ * empty.
+ */
+static bool ws_pop(WsDeque *d, int *tile) {
+    uint64_t r = atomic_load(&d->range);
+
+    for (;;) {
+        uint32_t head = (uint32_t)r, tail = (uint32_t)(r >> 32);
+        if (head >= tail) return false;
+        if (atomic_compare_exchange_weak(&d->range, &r, ws_pack(head + 1, tail))) {
+            *tile = (int)head;
+            return true;
+        }
+    }
+}
+
+/*
+ * Moves the back half (rounded up) of victim's range into thief, which must be
+ * empty and owned by the caller.  Returns false if there was nothing to steal.
+ */
+static bool ws_steal(WsDeque *victim, WsDeque *thief) {
+    uint64_t r = atomic_load(&victim->range);
+
+    for (;;) {
+        uint32_t head = (uint32_t)r, tail = (uint32_t)(r >> 32);
+        if (head >= tail) return false;
+
+        uint32_t mid = tail - (tail - head + 1) / 2;
+        if (atomic_compare_exchange_weak(&victim->range, &r, ws_pack(head, mid))) {
+            atomic_store(&thief->range, ws_pack(mid, tail));
+            return true;
+        }
+    }
+}
+
+static void *ws_worker(void *arg) {
+    WsWorker *w = arg;
+    WsPool *pool = w->pool;
+    WsDeque *mine = &pool->deques[w->id];
+    int node = numa_worker_node(w->id, pool->nworkers);
+    int tile;
+
+    if (w->id) numa_pin(w->id, pool->nworkers, NULL);
+    for (;;) {
+        while (ws_pop(mine, &tile)) {
+            pool->fn(pool->ctx, tile);
+        }
+
+        // Out of work:  look for a victim, starting with our neighbour so that
+        // thieves spread out instead of all hitting worker 0, and trying the
+        // workers on our own NUMA node (all of them, without placement) before
+        // the rest.  If every deque is empty, every tile has been claimed and we
+        // are done.
+        bool stole = false;
+        for (int pass = 0; pass < 2 && !stole; pass++) {
+            for (int i = 1; i < pool->nworkers && !stole; i++) {
+                int v = (w->id + i) % pool->nworkers;
+                if ((numa_worker_node(v, pool->nworkers) == node) != (pass == 0)) continue;
+                stole = ws_steal(&pool->deques[v], mine);
+            }
+        }
+        if (!stole) return NULL;
+    }
+} // ws_worker
+
+/*
+ * Runs fn(ctx, t) for every tile t in [0, ntiles) on nthreads pthreads (see
+ * num_threads), with work stealing.  Each thread starts with an equal,
+ * contiguous share of the tiles, as in run_tiles_static, and a thread that runs
+ * out steals from the others.  Each tile still runs on exactly one thread, but
+ * uneven tiles (e.g. the ragged edges when the block size doesn't divide n) no
+ * longer leave threads idle at the end.  The calling thread is worker 0, and the
+ * call returns once every tile is done.
+ */
+void run_tiles_ws(int nthreads, int ntiles, TileFn fn, void *ctx) {
+    nthreads = num_threads(nthreads);
+    if (nthreads > ntiles) nthreads = ntiles;
+    if (nthreads <= 1) {
+        for (int t = 0; t < ntiles; t++) {
+            fn(ctx, t);
+        }
+        return;
+    }
+
+    pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+    WsWorker *workers = malloc(nthreads * sizeof(WsWorker));
+    WsDeque *deques = aligned_alloc(64, nthreads * sizeof(WsDeque));
+    WsPool pool = {.fn = fn, .ctx = ctx, .nworkers = nthreads, .deques = deques};
+
+    for (int i = 0; i < nthreads; i++) {
+        uint32_t first = (uint32_t)((long)ntiles * i / nthreads);
+        uint32_t last = (uint32_t)((long)ntiles * (i + 1) / nthreads);
+        atomic_init(&deques[i].range, ws_pack(first, last));
+        workers[i] = (WsWorker){.pool = &pool, .id = i};
+    }
+    for (int i = 1; i < nthreads; i++) {
+        pthread_create(&tids[i], NULL, ws_worker, &workers[i]);
+    }
+    cpu_set_t saved;
+    bool pinned = numa_pin(0, nthreads, &saved);
+    ws_worker(&workers[0]);
+    if (pinned) numa_unpin(&saved);
+    for (int i = 1; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    free(deques);
+    free(workers);
+    free(tids);
+} // run_tiles_ws
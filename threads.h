@@ -0,0 +1,14 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+/*
+ * A unit of parallel work:  fn(ctx, tile) computes tile number `tile` of some
+ * kernel.  Tiles passed to different threads must not write the same memory.
+ */
+typedef void (*TileFn)(void *ctx, int tile);
+
+int num_threads(int);
+void run_tiles_static(int nthreads, int ntiles, TileFn fn, void *ctx);
+void run_tiles_ws(int nthreads, int ntiles, TileFn fn, void *ctx);
+
+#endif
@@ -2,7 +2,8 @@
  *  transpose.c
  *  CS3410 (F'24)
  *
- *  USAGE:  transpose  <matrix_dimension>
+ *  USAGE:  transpose  [-b <block_size>] [-t <threads>] [-T <type>] [-N]
+ *                     [-w <warmup>] [-r <reps>] [-o csv|json] [-k <variant>] <matrix_dimension>
  *
  *  OVERVIEW:  Driver to test the performance of various cache-aware optimizations
  *    on the basic matrix transposition algorithm.
@@ -14,18 +15,178 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
+#include "alloc.h"
+#include "bench.h"
 #include "helpers.h"
+#include "layout.h"
+#include "perf.h"
+#include "placement.h"
+#include "simd.h"
+#include "threads.h"
+#include "tune.h"
+
+/*
+ * The benchmark for -T <type> other than double:  the blocked transpose from
+ * typed.c for that element type, against the same kernel for double.
+ */
+static void typed_benchmark(Args args) {
+    int n = args.n;
+    long long start, end;
+    ElemType types[2] = {ELEM_F64, args.type};
+    double *M = make_one_matrix(n);
+
+    printf("Transpose throughput, blocked (block size = %d)\n", args.blocksz);
+    printf("---------------------------------------------------------\n");
+    for (int v = 0; v < 2; v++) {
+        void *T = make_typed_matrix(types[v], false, n, M);
+        void *T_t = make_typed_matrix(types[v], false, n, NULL);
+
+        start = timeInMilliseconds();
+        transpose_bl_typed(types[v], n, args.blocksz, T, T_t);
+        end = timeInMilliseconds();
+        print_results_bandwidth(elem_name(types[v]), n, elem_size(types[v], false), end - start);
+
+        matrix_free(T);
+        matrix_free(T_t);
+    }
+    printf("---------------------------------------------------------\n\n");
+    matrix_free(M);
+} // typed_benchmark
+
+/*
+ * The operands of the harness variants.  T and T_t are M and M_t in tile-major
+ * storage; M_ip is transposed in place, back and forth.
+ */
+typedef struct tr_bench_t {
+    int n, bs, tl_bs, threads;
+    double *M, *M_t, *M_ip, *T, *T_t;
+} TrBench;
+
+static void tr_naive(void *p) {
+    TrBench *t = p;
+    transpose(t->n, t->M, t->M_t);
+}
+
+static void tr_interchange(void *p) {
+    TrBench *t = p;
+    transpose_li(t->n, t->M, t->M_t);
+}
+
+static void tr_blocked(void *p) {
+    TrBench *t = p;
+    transpose_bl(t->n, t->bs, t->M, t->M_t);
+}
+
+static void tr_blocked_ws(void *p) {
+    TrBench *t = p;
+    transpose_bl_ws(t->n, t->bs, t->threads, t->M, t->M_t);
+}
+
+static void tr_recursive(void *p) {
+    TrBench *t = p;
+    transpose_rec(t->n, t->M, t->M_t);
+}
+
+static void tr_inplace(void *p) {
+    TrBench *t = p;
+    transpose_inplace(t->n, t->M_ip);
+}
+
+static void tr_inplace_mt(void *p) {
+    TrBench *t = p;
+    transpose_inplace_mt(t->n, t->threads, t->M_ip);
+}
+
+static void tr_tile_major(void *p) {
+    TrBench *t = p;
+    transpose_tl(t->n, t->tl_bs, t->T, t->T_t);
+}
+
+static void tr_memcpy(void *p) {
+    TrBench *t = p;
+    memcpy(t->M_t, t->M, (size_t)t->n * t->n * sizeof(double));
+}
+
+// Every variant the harness knows, by the name -k selects it with
+static const struct {
+    const char *name;
+    BenchFn run;
+} Tr_Variants[] = {
+    {"naive", tr_naive},
+    {"interchange", tr_interchange},
+    {"blocked", tr_blocked},
+    {"blocked-ws", tr_blocked_ws},
+    {"recursive", tr_recursive},
+    {"in-place", tr_inplace},
+    {"in-place-mt", tr_inplace_mt},
+    {"tile-major", tr_tile_major},
+    {"memcpy", tr_memcpy},
+};
+
+/*
+ * The benchmark harness (-o), as in matmult.c:  -w warmup and -r timed runs of each
+ * variant (or just -k's), caches flushed before each, one record per variant.
+ * Every variant overwrites its whole output, so none needs a reset between runs.
+ */
+static void harness(Args args) {
+    int n = args.n, count = sizeof(Tr_Variants) / sizeof(Tr_Variants[0]);
+    TrBench t = {
+        .n = n, .bs = args.blocksz, .tl_bs = (args.blocksz > 1 ? args.blocksz : LAYOUT_TILE),
+        .threads = num_threads(args.threads),
+        .M = make_one_matrix(n), .M_t = make_one_matrix(n), .M_ip = make_one_matrix(n),
+    };
+    bool found = false;
+
+    t.T = make_tiled_matrix(n, t.tl_bs);
+    t.T_t = make_tiled_matrix(n, t.tl_bs);
+    to_tiled(n, t.tl_bs, t.M, t.T);
+
+    bench_emit_header(stdout, args.format);
+    for (int v = 0; v < count; v++) {
+        if (args.kernel && strcmp(args.kernel, Tr_Variants[v].name)) continue;
+        found = true;
+
+        BenchRecord rec = {
+            .program = "transpose", .variant = Tr_Variants[v].name, .n = n,
+            .blocksz = (Tr_Variants[v].run == tr_tile_major ? t.tl_bs : args.blocksz),
+            .threads = t.threads, .simd = Simd.name, .flops = 0, .bytes = 2.0 * n * n * sizeof(double),
+        };
+        rec.stats = bench_run(Tr_Variants[v].run, NULL, &t, args.warmup, args.reps);
+        bench_emit(stdout, args.format, &rec);
+    }
+    if (!found) fprintf(stderr, "No variant named %s.\n", args.kernel);
+
+    matrix_free(t.M);
+    matrix_free(t.M_t);
+    matrix_free(t.M_ip);
+    matrix_free(t.T);
+    matrix_free(t.T_t);
+} // harness
 
 int main(int argc, char **argv) {
     long long start_blocked, end_blocked;
     long long start_basic, end_basic;
     unsigned long total_basic, total_blocked; // The time to completion of A*B = C, in seconds
 
-    int n = get_arg(argc, argv);
+    Args args = get_args(argc, argv);
+    int n = args.n;
     bool verbose = n <= 16; // Should we display the matrix calculation, too?
 
+    // Resolve the default block size here, so the reports show the one in use
+    if (args.blocksz <= 0) args.blocksz = tune_block(TUNE_TRANSPOSE_BL, n);
+
+    if (args.format != BENCH_CONSOLE) {
+        harness(args);
+        return 0;
+    }
+    if (args.type != ELEM_F64) {
+        typed_benchmark(args);
+        return 0;
+    }
+
     printf("\n(creating test matrices ...");
     fflush(stdout);
     double *M = make_one_matrix(n);
@@ -34,18 +195,26 @@ int main(int argc, char **argv) {
     printf(" performing benchmark ...");
     fflush(stdout);
 
-    start_basic = timeInMilliseconds();
+    // The naive, interchange and blocked transposes are instrumented (see perf.h);
+    // the rest are timed to the millisecond, as before.
+    PerfSession perf;
+    PerfSample s_basic, s_li, s_bl;
+
+    perf_open(&perf);
+
+    perf_start(&perf);
     transpose(n, M, M_t);
-    end_basic = timeInMilliseconds();
+    s_basic = perf_stop(&perf);
 
-    start_blocked = timeInMilliseconds();
-    transpose_bl(n, M, M_t);
-    end_blocked = timeInMilliseconds();
+    perf_start(&perf);
+    transpose_bl(n, args.blocksz, M, M_t);
+    s_bl = perf_stop(&perf);
 
     printf(" done)\n\n");
 
-    total_basic = end_basic - start_basic;
-    total_blocked = end_blocked - start_blocked;
+    total_basic = s_basic.ns / 1000000;
+    total_blocked = s_bl.ns / 1000000;
+    unsigned long total_naive = total_basic;
     // Not strictly valid timing, since we've including function call/return overhead.
 
     if (verbose) { // main
@@ -58,20 +227,140 @@ int main(int argc, char **argv) {
     }
 
     printf("Time to calculate the transpose of a %d x %d matrix\n", n, n);
-    print_results_transpose(n, BLOCKSZ, total_basic, total_blocked);
+    print_results_transpose(n, args.blocksz, total_basic, total_blocked);
 
     // Loop interchange offers no benefit for transpose, but we might as well include it ...
     printf("\n----------------------------------------------------------\n");
     printf("   (results with loop interchange version)\n");
     printf("-------------------------------------\n");
-    start_basic = timeInMilliseconds();
+    perf_start(&perf);
     transpose_li(n, M, M_t);
-    end_basic = timeInMilliseconds();
-    total_basic = end_basic - start_basic;
+    s_li = perf_stop(&perf);
+    total_basic = s_li.ns / 1000000;
     if (verbose) { // main
         printf("\nM_t:\n");
         print_one_matrix(n, M_t, true);
     }
     printf("  TIME TO COMPLETION = %lu msec.\n\n\n", (total_basic));
+    unsigned long total_li = total_basic;
+
+    // The cache-oblivious transpose, with in-register micro-transposes, and memcpy as
+    // the bandwidth ceiling:  a copy reads and writes as many bytes as a transpose.
+    start_basic = timeInMilliseconds();
+    transpose_rec(n, M, M_t);
+    end_basic = timeInMilliseconds();
+    unsigned long total_rec = end_basic - start_basic;
+
+    // In place, on a copy of M (transposed back afterwards, to check the round trip)
+    double *M_ip = make_one_matrix(n);
+    start_basic = timeInMilliseconds();
+    transpose_inplace(n, M_ip);
+    end_basic = timeInMilliseconds();
+    unsigned long total_ip = end_basic - start_basic;
+    bool ip_ok = !memcmp(M_ip, M_t, n * n * sizeof(double));
+
+    start_basic = timeInMilliseconds();
+    transpose_inplace_mt(n, args.threads, M_ip);
+    end_basic = timeInMilliseconds();
+    unsigned long total_ip_mt = end_basic - start_basic;
+    ip_ok = ip_ok && !memcmp(M_ip, M, n * n * sizeof(double));
+
+    double *M_copy = make_one_matrix(n);
+    start_basic = timeInMilliseconds();
+    memcpy(M_copy, M, n * n * sizeof(double));
+    end_basic = timeInMilliseconds();
+    unsigned long total_copy = end_basic - start_basic;
+
+    printf("Transpose throughput (%s kernels)\n", Simd.name);
+    printf("---------------------------------------------------------\n");
+    print_results_bandwidth("naive", n, sizeof(double), total_naive);
+    print_results_bandwidth("interchange", n, sizeof(double), total_li);
+    print_results_bandwidth("blocked", n, sizeof(double), total_blocked);
+    print_results_bandwidth("recursive", n, sizeof(double), total_rec);
+    print_results_bandwidth("in-place", n, sizeof(double), total_ip);
+    print_results_bandwidth("in-place (mt)", n, sizeof(double), total_ip_mt);
+    print_results_bandwidth("memcpy", n, sizeof(double), total_copy);
+    if (!ip_ok) printf("  (MISMATCH in the in-place transpose)\n");
+    printf("---------------------------------------------------------\n\n");
+
+    // No arithmetic, and a nominal read and write of each element, as above
+    double bytes = 2.0 * n * n * sizeof(double);
+
+    printf("Hardware counters%s\n", (perf_available(&perf) ? "" : " (unavailable here: timing only)"));
+    printf("---------------------------------------------------------\n");
+    print_results_perf("naive", s_basic, 0, bytes);
+    print_results_perf("interchange", s_li, 0, bytes);
+    print_results_perf("blocked", s_bl, 0, bytes);
+    printf("---------------------------------------------------------\n\n");
+    perf_close(&perf);
+
+    // Row-major against tile-major storage, end to end:  the blocked transpose of M,
+    // against converting M to tiles, transposing tile for tile, and converting the
+    // result back.  Both use the same tile size (-b, when it's more than 1, else
+    // LAYOUT_TILE).
+    int tl_bs = (args.blocksz > 1 ? args.blocksz : LAYOUT_TILE);
+    double *T = make_tiled_matrix(n, tl_bs), *T_t = make_tiled_matrix(n, tl_bs);
+    double *M_t_tl = make_one_matrix(n);
+    unsigned long total_rm, total_in, total_tl, total_out;
+
+    start_basic = timeInMilliseconds();
+    transpose_bl(n, tl_bs, M, M_t);
+    end_basic = timeInMilliseconds();
+    total_rm = end_basic - start_basic;
+
+    start_basic = timeInMilliseconds();
+    to_tiled(n, tl_bs, M, T);
+    end_basic = timeInMilliseconds();
+    total_in = end_basic - start_basic;
+
+    start_basic = timeInMilliseconds();
+    transpose_tl(n, tl_bs, T, T_t);
+    end_basic = timeInMilliseconds();
+    total_tl = end_basic - start_basic;
+
+    start_basic = timeInMilliseconds();
+    from_tiled(n, tl_bs, T_t, M_t_tl);
+    end_basic = timeInMilliseconds();
+    total_out = end_basic - start_basic;
+
+    printf("Row-major vs. tile-major storage (tile = %d)\n", tl_bs);
+    printf("---------------------------------------------------------\n");
+    print_results_bandwidth("row-major", n, sizeof(double), total_rm);
+    print_results_bandwidth("tiled: in", n, sizeof(double), total_in);
+    print_results_bandwidth("tiled: kernel", n, sizeof(double), total_tl);
+    print_results_bandwidth("tiled: out", n, sizeof(double), total_out);
+    print_results_bandwidth("tiled: total", n, sizeof(double), total_in + total_tl + total_out);
+    if (memcmp(M_t, M_t_tl, n * n * sizeof(double))) printf("  (MISMATCH in the tile-major transpose)\n");
+    printf("---------------------------------------------------------\n\n");
+    matrix_free(T);
+    matrix_free(T_t);
+    matrix_free(M_t_tl);
+
+    // Scaling of the work-stealing blocked transpose, from 1 thread up to -t (or one
+    // per CPU), doubling each time.  M_t already holds the transpose, as reference.
+    int max_threads = num_threads(args.threads);
+    double *M_t_mt = make_one_matrix(n);
+    unsigned long total_one = 0;
+
+    printf("Multithreaded blocked transpose, work-stealing (block size = %d, NUMA placement %s)\n", args.blocksz,
+           (Numa_Placement ? "on" : "off"));
+    printf("---------------------------------------------------------\n");
+    for (int t = 1;; t = (t * 2 < max_threads ? t * 2 : max_threads)) {
+        zero(n, M_t_mt);
+        start_blocked = timeInMilliseconds();
+        transpose_bl_ws(n, args.blocksz, t, M, M_t_mt);
+        end_blocked = timeInMilliseconds();
+        if (t == 1) total_one = end_blocked - start_blocked;
+
+        print_results_threads(t, total_one, end_blocked - start_blocked,
+                              !memcmp(M_t, M_t_mt, n * n * sizeof(double)));
+        if (t == max_threads) break;
+    }
+    printf("---------------------------------------------------------\n\n");
 
+    matrix_free(M);
+    matrix_free(M_t);
+    matrix_free(M_ip);
+    matrix_free(M_copy);
+    matrix_free(M_t_mt);
 } // main
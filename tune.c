@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "tasks.h"
+#include "tune.h"
+
+// Directory under $HOME for the default per-host profiles
+#define PROFILE_DIR ".cacheblock"
+
+TuneProfile Tune_Profile;
+
+// Tile_Sizes as compiled in, before any profile replaced them (see tune_reset)
+static TileSizes Default_Tiles;
+
+static const char *Kernel_Names[TUNE_KERNELS] = {"matmult_bl", "transpose_bl"};
+
+const char *tune_kernel_name(TuneKernel k) {
+    return (k >= 0 && k < TUNE_KERNELS) ? Kernel_Names[k] : "?";
+} // tune_kernel_name
+
+/*
+ * The block size for kernel k at matrix size n:  the profile's entry for the
+ * smallest tuned size >= n, or for the largest one if n is past them all.  Without
+ * a profile, the compile-time default, BLOCKSZ.
+ */
+int tune_block(TuneKernel k, int n) {
+    int count = Tune_Profile.count[k];
+
+    if (count == 0) return BLOCKSZ;
+    for (int e = 0; e < count; e++) {
+        if (Tune_Profile.entry[k][e].n >= n) return Tune_Profile.entry[k][e].bs;
+    }
+    return Tune_Profile.entry[k][count - 1].bs;
+} // tune_block
+
+/*
+ * Where this host's profile lives:  $CACHEBLOCK_PROFILE if set (empty, or "off",
+ * turns profiles off, and gives NULL), else ~/.cacheblock/<hostname>.profile.  The
+ * host name is part of the default, so machines that share a home directory keep
+ * separate profiles.  NULL if there's no $HOME either.
+ */
+const char *tune_profile_path(void) {
+    static char path[PATH_MAX];
+    char host[256];
+    char *env = getenv("CACHEBLOCK_PROFILE"), *home = getenv("HOME");
+
+    if (env) return (*env && strcmp(env, "off")) ? env : NULL;
+    if (!home) return NULL;
+
+    if (gethostname(host, sizeof(host))) strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+    snprintf(path, sizeof(path), "%s/%s/%s.profile", home, PROFILE_DIR, host);
+    return path;
+} // tune_profile_path
+
+/*
+ * Sets kernel k's block size for n x n matrices in P to bs, keeping the entries in
+ * increasing order of n; an existing entry for the same n is replaced.  Returns
+ * false if P already holds TUNE_MAX_SIZES other sizes.
+ */
+bool tune_set(TuneProfile *P, TuneKernel k, int n, int bs) {
+    TuneEntry *entry = P->entry[k];
+    int e = 0;
+
+    while (e < P->count[k] && entry[e].n < n) e++;
+    if (e < P->count[k] && entry[e].n == n) {
+        entry[e].bs = bs;
+        return true;
+    }
+    if (P->count[k] == TUNE_MAX_SIZES) return false;
+
+    memmove(entry + e + 1, entry + e, (P->count[k] - e) * sizeof(TuneEntry));
+    entry[e] = (TuneEntry){.n = n, .bs = bs};
+    P->count[k]++;
+    return true;
+} // tune_set
+
+/*
+ * Reads the profile at `path` into P.  The format is line-oriented text, with '#'
+ * starting a comment:
+ *
+ *   <kernel> <n> <block size>     e.g. "matmult_bl 1024 64"
+ *   tiles <kc> <mc> <nc>
+ *
+ * Returns 0, or -1 with errno set (EINVAL for a malformed line; P is then left
+ * empty).
+ */
+int tune_load(const char *path, TuneProfile *P) {
+    FILE *f = fopen(path, "r");
+    char line[256], word[32];
+    int a, b, c;
+
+    if (!f) return -1;
+
+    memset(P, 0, sizeof(*P));
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        bool ok = false;
+
+        if (hash) *hash = '\0';
+        int fields = sscanf(line, "%31s %d %d %d", word, &a, &b, &c);
+        if (fields <= 0) continue;
+
+        if (!strcmp(word, "tiles") && fields == 4 && a > 0 && b > 0 && c > 0) {
+            P->have_tiles = true;
+            P->tiles = (TileSizes){.kc = a, .mc = b, .nc = c};
+            ok = true;
+        }
+        for (TuneKernel k = 0; k < TUNE_KERNELS; k++) {
+            if (!strcmp(word, Kernel_Names[k]) && fields == 3 && a > 0 && b > 0) ok = tune_set(P, k, a, b);
+        }
+        if (!ok) {
+            memset(P, 0, sizeof(*P));
+            fclose(f);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+} // tune_load
+
+/*
+ * Writes P to `path`, creating its directory if need be.  The profile is written
+ * to a temporary file and renamed into place, so a reader never sees half of one.
+ * Returns 0, or -1 with errno set.
+ */
+int tune_save(const char *path, const TuneProfile *P) {
+    char dir[PATH_MAX], tmp[PATH_MAX + 8], host[256];
+    char *slash;
+    time_t now = time(NULL);
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) && errno != EEXIST) return -1;
+    }
+    if (gethostname(host, sizeof(host))) strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    fprintf(f, "# cacheblock tuning profile for %s, written %s", host, ctime(&now));
+    fprintf(f, "# <kernel> <n> <block size>: the best block size for n x n matrices\n");
+    for (TuneKernel k = 0; k < TUNE_KERNELS; k++) {
+        for (int e = 0; e < P->count[k]; e++) {
+            fprintf(f, "%s %d %d\n", Kernel_Names[k], P->entry[k][e].n, P->entry[k][e].bs);
+        }
+    }
+    if (P->have_tiles) {
+        fprintf(f, "# tiles <kc> <mc> <nc>: the cache tiles (Tile_Sizes), tuned on matmult_packed\n");
+        fprintf(f, "tiles %d %d %d\n", P->tiles.kc, P->tiles.mc, P->tiles.nc);
+    }
+    if (fclose(f) || rename(tmp, path)) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+} // tune_save
+
+/*
+ * Makes P the profile in effect:  block sizes <= 0 resolve through it from now
+ * on, and its tiles (if it has them) replace Tile_Sizes.
+ */
+void tune_apply(const TuneProfile *P) {
+    Tune_Profile = *P;
+    if (P->have_tiles) Tile_Sizes = P->tiles;
+} // tune_apply
+
+/*
+ * Back to the compiled-in parameters, as if there were no profile:  BLOCKSZ for
+ * every block size <= 0, and the default Tile_Sizes.  For the test drivers, whose
+ * results mustn't depend on how the host happens to be tuned.
+ */
+void tune_reset(void) {
+    memset(&Tune_Profile, 0, sizeof(Tune_Profile));
+    Tile_Sizes = Default_Tiles;
+} // tune_reset
+
+/*
+ * Loads this host's profile (see tune_profile_path) at startup, if there is one.
+ * A missing profile is the normal case; a malformed one is reported and ignored.
+ */
+__attribute__((constructor)) static void tune_init(void) {
+    const char *path = tune_profile_path();
+    TuneProfile P;
+
+    Default_Tiles = Tile_Sizes;
+    if (!path) return;
+    if (!tune_load(path, &P)) {
+        tune_apply(&P);
+    } else if (errno != ENOENT) {
+        fprintf(stderr, "Ignoring the tuning profile %s: %s\n", path, strerror(errno));
+    }
+} // tune_init
@@ -0,0 +1,47 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdbool.h>
+
+#include "tasks.h"
+
+// Most matrix sizes a profile keeps a block size for, per kernel
+#define TUNE_MAX_SIZES 16
+
+// The kernels whose block size a profile holds
+typedef enum tune_kernel_t {
+    TUNE_MATMULT_BL,   // matmult_bl, matmult_bl_mt, matmult_bl_ws
+    TUNE_TRANSPOSE_BL, // transpose_bl, transpose_bl_ws
+    TUNE_KERNELS
+} TuneKernel;
+
+// The best block size found for matrices of size n
+typedef struct tune_entry_t {
+    int n, bs;
+} TuneEntry;
+
+/*
+ * The tuned parameters for one host:  for each TuneKernel, the winning block size
+ * at each matrix size tried (in increasing order of n), and the winning cache
+ * tiles, Tile_Sizes, as tuned on matmult_packed (matmult_tiled uses them too, but
+ * isn't timed).
+ */
+typedef struct tune_profile_t {
+    int count[TUNE_KERNELS];
+    TuneEntry entry[TUNE_KERNELS][TUNE_MAX_SIZES];
+    bool have_tiles;
+    TileSizes tiles;
+} TuneProfile;
+
+extern TuneProfile Tune_Profile;
+
+int tune_block(TuneKernel, int n);
+bool tune_set(TuneProfile *, TuneKernel, int n, int bs);
+const char *tune_kernel_name(TuneKernel);
+const char *tune_profile_path(void);
+int tune_load(const char *path, TuneProfile *);
+int tune_save(const char *path, const TuneProfile *);
+void tune_apply(const TuneProfile *);
+void tune_reset(void);
+
+#endif
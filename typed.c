@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "helpers.h"
+#include "simd.h"
+#include "tasks.h"
+#include "tune.h"
+#include "typed.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+// The blocked kernels of double are matmult_bl and transpose_bl themselves, rather
+// than a second copy of them generated from typed_kernels.h.
+void matmult_bl_f64(int n, int blocksz, double *A, double *B, double *C) {
+    matmult_bl(n, blocksz, A, B, C);
+}
+
+void transpose_bl_f64(int n, int blocksz, double *M, double *M_t) {
+    transpose_bl(n, blocksz, M, M_t);
+}
+
+// ...and the rest, once per element type (see typed_kernels.h).
+#define TYPE_SUFFIX f32
+#define ELEM float
+#define ACC float
+#include "typed_kernels.h"
+#undef TYPE_SUFFIX
+#undef ELEM
+#undef ACC
+
+#define TYPE_SUFFIX i32
+#define ELEM int32_t
+#define ACC int32_t
+#include "typed_kernels.h"
+#undef TYPE_SUFFIX
+#undef ELEM
+#undef ACC
+
+#define TYPE_SUFFIX i8
+#define ELEM int8_t
+#define ACC int32_t
+#include "typed_kernels.h"
+#undef TYPE_SUFFIX
+#undef ELEM
+#undef ACC
+
+/////////////////////////////////////////////////////////////////////////
+static const char *Elem_Names[ELEM_TYPES] = {"double", "float", "int32", "int8"};
+
+const char *elem_name(ElemType t) {
+    return (t >= 0 && t < ELEM_TYPES) ? Elem_Names[t] : "?";
+} // elem_name
+
+/*
+ * Returns the ElemType named `name` (as printed by elem_name), or -1 if there is
+ * none.
+ */
+int elem_parse(const char *name) {
+    for (int t = 0; t < ELEM_TYPES; t++) {
+        if (!strcmp(name, Elem_Names[t])) return t;
+    }
+    return -1;
+} // elem_parse
+
+/*
+ * The size in bytes of one element of an input matrix of type t, or, if `acc` is
+ * set, of a product.
+ */
+size_t elem_size(ElemType t, bool acc) {
+    switch (t) {
+    case ELEM_F64: return sizeof(double);
+    case ELEM_F32: return sizeof(float);
+    case ELEM_I32: return sizeof(int32_t);
+    case ELEM_I8:  return acc ? sizeof(int32_t) : sizeof(int8_t);
+    default:       return 0;
+    }
+} // elem_size
+
+/*
+ * Constructs an n x n matrix of type t (of its product type, if `acc` is set),
+ * holding the values of M converted to that type, or zeros if M is NULL.  As
+ * with make_one_matrix, the caller is responsible for freeing the result, with
+ * matrix_free.
+ */
+void *make_typed_matrix(ElemType t, bool acc, int n, double *M) {
+    ElemType s = (t == ELEM_I8 && acc) ? ELEM_I32 : t; // how the elements are stored
+    size_t bytes = (size_t)n * n * elem_size(t, acc);
+    void *T = matrix_alloc(bytes);
+
+    matrix_first_touch(T, bytes, 0);
+
+    for (long i = 0; M && i < (long)n * n; i++) {
+        switch (s) {
+        case ELEM_F64: ((double *)T)[i] = M[i]; break;
+        case ELEM_F32: ((float *)T)[i] = (float)M[i]; break;
+        case ELEM_I32: ((int32_t *)T)[i] = (int32_t)M[i]; break;
+        case ELEM_I8:  ((int8_t *)T)[i] = (int8_t)M[i]; break;
+        default:       break;
+        }
+    }
+    return T;
+} // make_typed_matrix
+
+/*
+ * Widens the n x n matrix Y of type t (of its product type, if `acc` is set) into
+ * the double matrix X, to compare with matrix_compare.
+ */
+void typed_to_double(ElemType t, bool acc, int n, void *Y, double *X) {
+    ElemType s = (t == ELEM_I8 && acc) ? ELEM_I32 : t;
+
+    for (long i = 0; i < (long)n * n; i++) {
+        switch (s) {
+        case ELEM_F64: X[i] = ((double *)Y)[i]; break;
+        case ELEM_F32: X[i] = ((float *)Y)[i]; break;
+        case ELEM_I32: X[i] = ((int32_t *)Y)[i]; break;
+        default:       X[i] = ((int8_t *)Y)[i]; break;
+        }
+    }
+} // typed_to_double
+
+/*
+ * matmult_bl_<type> for the ElemType t:  C += A * B, where A and B hold elements of
+ * type t and C of its product type.
+ */
+void matmult_bl_typed(ElemType t, int n, int blocksz, void *A, void *B, void *C) {
+    switch (t) {
+    case ELEM_F64: matmult_bl_f64(n, blocksz, A, B, C); break;
+    case ELEM_F32: matmult_bl_f32(n, blocksz, A, B, C); break;
+    case ELEM_I32: matmult_bl_i32(n, blocksz, A, B, C); break;
+    case ELEM_I8:  matmult_bl_i8(n, blocksz, A, B, C); break;
+    default:       break;
+    }
+} // matmult_bl_typed
+
+/*
+ * transpose_bl_<type> for the ElemType t.
+ */
+void transpose_bl_typed(ElemType t, int n, int blocksz, void *M, void *M_t) {
+    switch (t) {
+    case ELEM_F64: transpose_bl_f64(n, blocksz, M, M_t); break;
+    case ELEM_F32: transpose_bl_f32(n, blocksz, M, M_t); break;
+    case ELEM_I32: transpose_bl_i32(n, blocksz, M, M_t); break;
+    case ELEM_I8:  transpose_bl_i8(n, blocksz, M, M_t); break;
+    default:       break;
+    }
+} // transpose_bl_typed
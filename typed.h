@@ -0,0 +1,38 @@
+#ifndef TYPED_H
+#define TYPED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Element types for the typed kernels.  ELEM_I8 multiplies int8 matrices into an
+// int32 product;  every other type multiplies into its own type.
+typedef enum elem_type_t {
+    ELEM_F64, // double
+    ELEM_F32, // float
+    ELEM_I32, // int32_t
+    ELEM_I8,  // int8_t, accumulated in int32_t
+    ELEM_TYPES
+} ElemType;
+
+const char *elem_name(ElemType);
+int elem_parse(const char *);
+size_t elem_size(ElemType, bool acc);
+
+void *make_typed_matrix(ElemType, bool acc, int n, double *M);
+void typed_to_double(ElemType, bool acc, int n, void *Y, double *X);
+
+void matmult_bl_typed(ElemType, int n, int blocksz, void *A, void *B, void *C);
+void transpose_bl_typed(ElemType, int n, int blocksz, void *M, void *M_t);
+
+void matmult_bl_f64(int n, int blocksz, double *A, double *B, double *C);
+void matmult_bl_f32(int n, int blocksz, float *A, float *B, float *C);
+void matmult_bl_i32(int n, int blocksz, int32_t *A, int32_t *B, int32_t *C);
+void matmult_bl_i8(int n, int blocksz, int8_t *A, int8_t *B, int32_t *C);
+
+void transpose_bl_f64(int n, int blocksz, double *M, double *M_t);
+void transpose_bl_f32(int n, int blocksz, float *M, float *M_t);
+void transpose_bl_i32(int n, int blocksz, int32_t *M, int32_t *M_t);
+void transpose_bl_i8(int n, int blocksz, int8_t *M, int8_t *M_t);
+
+#endif
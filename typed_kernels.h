@@ -0,0 +1,115 @@
+/*
+ * The element-type-generic blocked kernels of typed.c, written once and included by
+ * typed.c once per element type.  (So, deliberately, there is no include guard.)
+ * Before each inclusion, typed.c defines:
+ *
+ *   TYPE_SUFFIX   suffix for the generated function names (f32, i32, i8)
+ *   ELEM          the element type of the inputs, A, B and M
+ *   ACC           the element type of a product, C, which accumulates A[i][k] * B[k][j]
+ *
+ * and #undefs them again afterwards.  The loops are left to the compiler's
+ * auto-vectorizer, which is given one copy of the multiply per instruction set
+ * (see matmult_bl_<suffix>); so float runs twice as many lanes per vector as
+ * double, and int8 four times as many as int32 until it is widened.
+ */
+
+#define TYPED_CAT_(name, suffix) name##_##suffix
+#define TYPED_CAT(name, suffix) TYPED_CAT_(name, suffix)
+#define TYPED_FN(name) TYPED_CAT(name, TYPE_SUFFIX)
+
+/*
+ * C[i0:i0+ilen][j0:j0+jlen] += A[i0:..][k0:k0+klen] * B[k0:..][j0:..], in the i-k-j
+ * order of matmult_bl, with every product formed in ACC.
+ */
+static inline __attribute__((always_inline)) void TYPED_FN(mm_tile)(int n, ELEM *restrict A, ELEM *restrict B,
+                                                                    ACC *restrict C, int i0, int j0, int k0,
+                                                                    int ilen, int jlen, int klen) {
+    for (int i = i0; i < i0 + ilen; i++) {
+        for (int k = k0; k < k0 + klen; k++) {
+            ACC a = A[i * n + k];
+            for (int j = j0; j < j0 + jlen; j++) {
+                C[i * n + j] += a * (ACC)B[k * n + j];
+            }
+        }
+    }
+}
+
+/*
+ * The block loops of matmult_bl, over bs x bs tiles.
+ */
+static inline __attribute__((always_inline)) void TYPED_FN(mm_kernel)(int n, int bs, ELEM *A, ELEM *B, ACC *C) {
+    for (int ii = 0; ii < n; ii += bs) {
+        int ilen = (n - ii < bs) ? (n - ii) : bs;
+        for (int jj = 0; jj < n; jj += bs) {
+            int jlen = (n - jj < bs) ? (n - jj) : bs;
+            for (int kk = 0; kk < n; kk += bs) {
+                int klen = (n - kk < bs) ? (n - kk) : bs;
+                TYPED_FN(mm_tile)(n, A, B, C, ii, jj, kk, ilen, jlen, klen);
+            }
+        }
+    }
+}
+
+static void TYPED_FN(matmult_bl_base)(int n, int bs, ELEM *A, ELEM *B, ACC *C) {
+    TYPED_FN(mm_kernel)(n, bs, A, B, C);
+}
+
+#if SIMD_X86
+__attribute__((target("avx2,fma"))) static void TYPED_FN(matmult_bl_avx2)(int n, int bs, ELEM *A, ELEM *B, ACC *C) {
+    TYPED_FN(mm_kernel)(n, bs, A, B, C);
+}
+
+__attribute__((target("avx512f"))) static void TYPED_FN(matmult_bl_avx512)(int n, int bs, ELEM *A, ELEM *B,
+                                                                           ACC *C) {
+    TYPED_FN(mm_kernel)(n, bs, A, B, C);
+}
+#endif
+
+/*
+ * matmult_bl for this element type:  C += A * B, all n x n and row-major, with
+ * block size `blocksz` (<= 0 selects matmult_bl's tuned size for n, as for
+ * double, or BLOCKSZ without a profile; see tune.h).  The copy that runs is the
+ * one for the instruction set Simd is currently set to (see simd_select).
+ * Integer products must not overflow ACC.  The short-circuit hook is not consulted.
+ *
+ * PRECONDITIONS:  C is initialized to zero.
+ */
+void TYPED_FN(matmult_bl)(int n, int blocksz, ELEM *A, ELEM *B, ACC *C) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_MATMULT_BL, n);
+
+#if SIMD_X86
+    if (Simd.level >= SIMD_AVX512) {
+        TYPED_FN(matmult_bl_avx512)(n, blocksz, A, B, C);
+        return;
+    }
+    if (Simd.level >= SIMD_AVX2) {
+        TYPED_FN(matmult_bl_avx2)(n, blocksz, A, B, C);
+        return;
+    }
+#endif
+    TYPED_FN(matmult_bl_base)(n, blocksz, A, B, C);
+}
+
+/*
+ * transpose_bl for this element type:  M_t = the transpose of M, both n x n, in
+ * blocksz x blocksz tiles (<= 0 selects transpose_bl's tuned size for n).
+ */
+void TYPED_FN(transpose_bl)(int n, int blocksz, ELEM *M, ELEM *M_t) {
+    if (blocksz <= 0) blocksz = tune_block(TUNE_TRANSPOSE_BL, n);
+
+    for (int ii = 0; ii < n; ii += blocksz) {
+        int i_end = (ii + blocksz < n) ? (ii + blocksz) : n;
+        for (int jj = 0; jj < n; jj += blocksz) {
+            int j_end = (jj + blocksz < n) ? (jj + blocksz) : n;
+            for (int i = ii; i < i_end; i++) {
+                for (int j = jj; j < j_end; j++) {
+                    M_t[j * n + i] = M[i * n + j];
+                }
+            }
+        }
+    }
+}
+
+#undef TYPED_FN
+#undef TYPED_CAT
+#undef TYPED_CAT_